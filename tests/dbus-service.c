@@ -62,6 +62,20 @@ UPROF_STATIC_TIMER (loop1_sub_timer,
                     "An example sub timer for loop1",
                     0 /* no application private data */
 );
+UPROF_STATIC_COUNTER (tick_counter,
+                      "Tick counter",
+                      "Incremented by a timeout while the mainloop runs",
+                      0 /* no application private data */
+);
+
+static gboolean
+tick_cb (void *user_data)
+{
+  UProfContext *context = user_data;
+
+  UPROF_COUNTER_INC (context, tick_counter);
+  return TRUE;
+}
 
 
 int
@@ -137,6 +151,10 @@ main (int argc, char **argv)
   report = uprof_report_new ("Simple report");
   uprof_report_add_context (report, context);
 
+  /* Gives uprof-tool some rates to show */
+  uprof_context_start_sampling (context, 1000, 60);
+  g_timeout_add (100, tick_cb, context);
+
   mainloop = g_main_loop_new (NULL, TRUE);
   g_main_loop_run (mainloop);
   g_main_loop_unref (mainloop);
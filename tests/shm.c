@@ -0,0 +1,175 @@
+#include <uprof.h>
+
+#include <string.h>
+#include <unistd.h>
+
+/* Enough counters that the segment has to grow while a reader has it
+ * mapped */
+#define N_EXTRA_COUNTERS 100
+
+UPROF_STATIC_TIMER (shm_timer,
+                    NULL, /* no parent */
+                    "Shm timer",
+                    "A timer to be published to shared memory",
+                    0 /* no application private data */
+);
+
+UPROF_STATIC_TIMER (shm_child_timer,
+                    "Shm timer", /* parent */
+                    "Shm child timer",
+                    "A nested timer to be published to shared memory",
+                    0 /* no application private data */
+);
+
+UPROF_STATIC_COUNTER (shm_counter,
+                      "Shm counter",
+                      "A counter to be published to shared memory",
+                      0 /* no application private data */
+);
+
+static UProfCounter extra_counters[N_EXTRA_COUNTERS];
+
+static UProfSnapshotCounter *
+find_counter (UProfSnapshot *snapshot, const char *name)
+{
+  UProfSnapshotContext *context = snapshot->contexts->data;
+  GList *l;
+
+  for (l = context->counters; l; l = l->next)
+    {
+      UProfSnapshotCounter *counter = l->data;
+      if (strcmp (counter->name, name) == 0)
+        return counter;
+    }
+
+  return NULL;
+}
+
+static UProfSnapshotTimer *
+find_timer (UProfSnapshot *snapshot, const char *name)
+{
+  UProfSnapshotContext *context = snapshot->contexts->data;
+  GList *l;
+
+  for (l = context->timers; l; l = l->next)
+    {
+      UProfSnapshotTimer *timer = l->data;
+      if (strcmp (timer->name, name) == 0)
+        return timer;
+    }
+
+  return NULL;
+}
+
+static UProfSnapshot *
+read_snapshot (UProfShmReader *reader)
+{
+  GError *error = NULL;
+  UProfSnapshot *snapshot = uprof_shm_reader_read (reader, &error);
+
+  if (!snapshot)
+    g_error ("Failed to read shared memory segment: %s", error->message);
+
+  return snapshot;
+}
+
+int
+main (int argc, char **argv)
+{
+  UProfContext *context;
+  UProfShmExport *shm_export;
+  UProfShmExport *new_export;
+  UProfShmReader *reader;
+  UProfSnapshot *snapshot;
+  UProfSnapshotContext *snapshot_context;
+  UProfSnapshotCounter *counter;
+  UProfSnapshotTimer *timer;
+  GError *error = NULL;
+  char *name;
+  int i;
+
+  uprof_init (&argc, &argv);
+
+  context = uprof_context_new ("Shm context");
+
+  name = g_strdup_printf ("/uprof-shm-test-%d", (int)getpid ());
+
+  shm_export = uprof_shm_export_new (context, name, &error);
+  if (!shm_export)
+    g_error ("Failed to export context: %s", error->message);
+
+  for (i = 0; i < 3; i++)
+    UPROF_COUNTER_INC (context, shm_counter);
+  UPROF_TIMER_START (context, shm_timer);
+  UPROF_TIMER_START (context, shm_child_timer);
+  UPROF_TIMER_STOP (context, shm_child_timer);
+  UPROF_TIMER_STOP (context, shm_timer);
+
+  uprof_shm_export_publish (shm_export);
+
+  reader = uprof_shm_reader_open (name, &error);
+  if (!reader)
+    g_error ("Failed to open shared memory segment: %s", error->message);
+
+  snapshot = read_snapshot (reader);
+
+  g_assert (snapshot->counter_hz == uprof_get_system_counter_hz ());
+  g_assert (g_list_length (snapshot->contexts) == 1);
+  snapshot_context = snapshot->contexts->data;
+  g_assert (strcmp (snapshot_context->name, "Shm context") == 0);
+
+  counter = find_counter (snapshot, "Shm counter");
+  g_assert (counter && counter->count == 3);
+
+  timer = find_timer (snapshot, "Shm timer");
+  g_assert (timer && timer->count == 1 && timer->parent_name == NULL);
+  g_assert (timer->fastest <= timer->slowest);
+
+  timer = find_timer (snapshot, "Shm child timer");
+  g_assert (timer && timer->count == 1);
+  g_assert (strcmp (timer->parent_name, "Shm timer") == 0);
+
+  uprof_snapshot_free (snapshot);
+
+  /* Publishing more records than the segment was created with makes
+   * it grow, which the reader should follow */
+  for (i = 0; i < N_EXTRA_COUNTERS; i++)
+    {
+      extra_counters[i].name = g_strdup_printf ("Extra counter %d", i);
+      extra_counters[i].description = "A counter to grow the segment";
+      UPROF_COUNTER_INC (context, extra_counters[i]);
+    }
+  UPROF_COUNTER_INC (context, shm_counter);
+
+  uprof_shm_export_publish (shm_export);
+
+  snapshot = read_snapshot (reader);
+  snapshot_context = snapshot->contexts->data;
+  g_assert (g_list_length (snapshot_context->counters) ==
+            N_EXTRA_COUNTERS + 1);
+  counter = find_counter (snapshot, "Shm counter");
+  g_assert (counter && counter->count == 4);
+  counter = find_counter (snapshot, "Extra counter 99");
+  g_assert (counter && counter->count == 1);
+  uprof_snapshot_free (snapshot);
+
+  /* Exporting again under the same name mustn't disturb a reader that
+   * still has the previous segment mapped */
+  new_export = uprof_shm_export_new (context, name, &error);
+  if (!new_export)
+    g_error ("Failed to re-export context: %s", error->message);
+
+  snapshot = read_snapshot (reader);
+  counter = find_counter (snapshot, "Shm counter");
+  g_assert (counter && counter->count == 4);
+  uprof_snapshot_free (snapshot);
+
+  uprof_shm_reader_close (reader);
+  uprof_shm_export_free (shm_export);
+  uprof_shm_export_free (new_export);
+
+  g_free (name);
+  uprof_context_unref (context);
+
+  return 0;
+}
@@ -2,6 +2,7 @@
 #include <uprof.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #define UPROF_DEBUG     1
 
@@ -63,6 +64,65 @@ UPROF_STATIC_TIMER (loop1_sub_timer,
                     0 /* no application private data */
 );
 
+/* Called from both loops; the call graph shows the time spent in it
+ * under each loop's timer even though it is declared with one parent */
+UPROF_STATIC_TIMER (helper_timer,
+                    "Full timer", /* parent */
+                    "Helper timer",
+                    "A timer for a helper called from both loops",
+                    0 /* no application private data */
+);
+
+/* The scoped timer is stopped on both return paths */
+static void
+helper (UProfContext *context, int i)
+{
+  UPROF_SCOPED_TIMER (context, helper_timer);
+  struct timespec delay;
+
+  DBG_PRINTF ("    <helper delay: 1/20 sec>\n");
+  delay.tv_sec = 0;
+  delay.tv_nsec = 1000000000/20;
+  nanosleep (&delay, NULL);
+
+  if (i % 2)
+    return;
+
+  DBG_PRINTF ("    <helper delay: 1/20 sec>\n");
+  nanosleep (&delay, NULL);
+}
+
+#ifdef UPROF_DISABLE
+/* simple-disabled is built with UPROF_DISABLE to check the macros
+ * still compile but never evaluate their arguments */
+static void
+check_disabled_macros (UProfContext *context)
+{
+  int evaluated = 0;
+
+  {
+    UPROF_SCOPED_TIMER ((evaluated++, context), helper_timer);
+  }
+  UPROF_TIMER_START ((evaluated++, context), full_timer);
+  UPROF_TIMER_STOP ((evaluated++, context), full_timer);
+  UPROF_RECURSIVE_TIMER_START ((evaluated++, context), full_timer);
+  UPROF_RECURSIVE_TIMER_STOP ((evaluated++, context), full_timer);
+  UPROF_THREADED_TIMER_START ((evaluated++, context), full_timer);
+  UPROF_THREADED_TIMER_STOP ((evaluated++, context), full_timer);
+  UPROF_COUNTER_INC ((evaluated++, context), loop0_counter);
+  UPROF_COUNTER_DEC ((evaluated++, context), loop0_counter);
+  UPROF_COUNTER_ZERO ((evaluated++, context), loop0_counter);
+  UPROF_THREADED_COUNTER_INC ((evaluated++, context), loop0_counter);
+  UPROF_THREADED_COUNTER_DEC ((evaluated++, context), loop0_counter);
+  UPROF_THREADED_COUNTER_ZERO ((evaluated++, context), loop0_counter);
+
+  if (evaluated)
+    {
+      fprintf (stderr, "Disabled UProf macros evaluated their arguments\n");
+      exit (1);
+    }
+}
+#endif
 
 int
 main (int argc, char **argv)
@@ -74,6 +134,11 @@ main (int argc, char **argv)
   uprof_init (&argc, &argv);
 
   context = uprof_context_new ("Simple context");
+  uprof_context_enable_call_graph (context);
+
+#ifdef UPROF_DISABLE
+  check_disabled_macros (context);
+#endif
 
 
   DBG_PRINTF ("start full timer (rdtsc = %" G_GUINT64_FORMAT ")\n",
@@ -99,6 +164,8 @@ main (int argc, char **argv)
       nanosleep (&delay, NULL);
       UPROF_TIMER_STOP (context, loop0_sub_timer);
 
+      helper (context, i);
+
       UPROF_TIMER_STOP (context, loop0_timer);
       DBG_PRINTF ("stop simple timer (rdtsc = %" G_GUINT64_FORMAT ")\n",
                   uprof_get_system_counter ());
@@ -124,6 +191,8 @@ main (int argc, char **argv)
       nanosleep (&delay, NULL);
       UPROF_TIMER_STOP (context, loop1_sub_timer);
 
+      helper (context, i);
+
       UPROF_TIMER_STOP (context, loop1_timer);
       DBG_PRINTF ("stop simple timer (rdtsc = %" G_GUINT64_FORMAT ")\n",
                   uprof_get_system_counter ());
@@ -135,6 +204,7 @@ main (int argc, char **argv)
 
   report = uprof_report_new ("Simple report");
   uprof_report_add_context (report, context);
+  uprof_report_set_top_self_timers (report, 5);
   uprof_report_print (report);
   uprof_report_unref (report);
 
@@ -0,0 +1,222 @@
+#include <uprof.h>
+#include <uprof-report-private.h>
+#include <uprof-snapshot-private.h>
+
+#include <string.h>
+
+UPROF_STATIC_TIMER (snapshot_timer,
+                    NULL, /* no parent */
+                    "Snapshot timer",
+                    "A timer to be included in snapshots",
+                    0 /* no application private data */
+);
+
+UPROF_STATIC_COUNTER (snapshot_counter,
+                      "Snapshot counter",
+                      "A counter to be included in snapshots",
+                      0 /* no application private data */
+);
+
+static UProfSnapshotCounter *
+find_counter (UProfSnapshot *snapshot, const char *name)
+{
+  UProfSnapshotContext *context = snapshot->contexts->data;
+  GList *l;
+
+  for (l = context->counters; l; l = l->next)
+    {
+      UProfSnapshotCounter *counter = l->data;
+      if (strcmp (counter->name, name) == 0)
+        return counter;
+    }
+
+  return NULL;
+}
+
+static UProfSnapshotTimer *
+find_timer (UProfSnapshot *snapshot, const char *name)
+{
+  UProfSnapshotContext *context = snapshot->contexts->data;
+  GList *l;
+
+  for (l = context->timers; l; l = l->next)
+    {
+      UProfSnapshotTimer *timer = l->data;
+      if (strcmp (timer->name, name) == 0)
+        return timer;
+    }
+
+  return NULL;
+}
+
+static UProfSnapshot *
+parse (GArray *data)
+{
+  GError *error = NULL;
+  UProfSnapshot *snapshot =
+    _uprof_snapshot_parse ((const guint8 *)data->data, data->len, &error);
+
+  if (!snapshot)
+    g_error ("Failed to parse snapshot: %s", error->message);
+
+  return snapshot;
+}
+
+/* Every truncation of a valid snapshot and any change to its header
+ * must be caught by the parser's checks */
+static void
+check_invalid_snapshots (GArray *data)
+{
+  guint8 *copy;
+  GError *error;
+  gsize len;
+
+  for (len = 0; len < data->len; len++)
+    {
+      error = NULL;
+      g_assert (!_uprof_snapshot_parse ((const guint8 *)data->data, len,
+                                        &error));
+      g_assert (error->domain == UPROF_SNAPSHOT_ERROR &&
+                error->code == UPROF_SNAPSHOT_ERROR_INVALID);
+      g_error_free (error);
+    }
+
+  copy = g_memdup (data->data, data->len);
+
+  copy[0] ^= 0xff;
+  error = NULL;
+  g_assert (!_uprof_snapshot_parse (copy, data->len, &error));
+  g_assert (error->code == UPROF_SNAPSHOT_ERROR_INVALID);
+  g_error_free (error);
+  copy[0] ^= 0xff;
+
+  /* The version follows the magic */
+  copy[4] ^= 0xff;
+  error = NULL;
+  g_assert (!_uprof_snapshot_parse (copy, data->len, &error));
+  g_assert (error->code == UPROF_SNAPSHOT_ERROR_UNSUPPORTED_VERSION);
+  g_error_free (error);
+
+  g_free (copy);
+}
+
+static UProfSnapshot *
+get_delta (UProfReport *report, guint32 *cursor)
+{
+  UProfSnapshot *snapshot;
+  GArray *data;
+
+  _uprof_report_get_snapshot_since (report, *cursor, cursor, &data, NULL);
+  snapshot = parse (data);
+  g_array_free (data, TRUE);
+
+  g_assert (snapshot->delta);
+
+  return snapshot;
+}
+
+/* Counters may go down between delta snapshots, and a reset has to be
+ * flagged even when the values have since overtaken the baseline */
+static void
+check_delta_snapshots (UProfReport *report, UProfContext *context)
+{
+  UProfSnapshot *snapshot;
+  UProfSnapshotCounter *counter;
+  UProfSnapshotTimer *timer;
+  guint32 cursor = 0;
+  int i;
+
+  /* The first delta for a new cursor has nothing to compare against */
+  snapshot = get_delta (report, &cursor);
+  counter = find_counter (snapshot, "Snapshot counter");
+  g_assert (counter->count == 3 && counter->delta == 3 && !counter->reset);
+  uprof_snapshot_free (snapshot);
+
+  UPROF_COUNTER_DEC (context, snapshot_counter);
+
+  snapshot = get_delta (report, &cursor);
+  counter = find_counter (snapshot, "Snapshot counter");
+  g_assert (counter->count == 2 && counter->delta == -1 && !counter->reset);
+  timer = find_timer (snapshot, "Snapshot timer");
+  g_assert (timer->count == 0 && !timer->reset);
+  uprof_snapshot_free (snapshot);
+
+  _uprof_report_reset (report, NULL);
+
+  for (i = 0; i < 5; i++)
+    UPROF_COUNTER_INC (context, snapshot_counter);
+  for (i = 0; i < 2; i++)
+    {
+      UPROF_TIMER_START (context, snapshot_timer);
+      UPROF_TIMER_STOP (context, snapshot_timer);
+    }
+
+  snapshot = get_delta (report, &cursor);
+  counter = find_counter (snapshot, "Snapshot counter");
+  g_assert (counter->count == 5 && counter->delta == 5 && counter->reset);
+  timer = find_timer (snapshot, "Snapshot timer");
+  g_assert (timer->count == 2 && timer->reset);
+  uprof_snapshot_free (snapshot);
+
+  snapshot = get_delta (report, &cursor);
+  counter = find_counter (snapshot, "Snapshot counter");
+  g_assert (counter->delta == 0 && !counter->reset);
+  timer = find_timer (snapshot, "Snapshot timer");
+  g_assert (timer->count == 0 && !timer->reset);
+  uprof_snapshot_free (snapshot);
+}
+
+int
+main (int argc, char **argv)
+{
+  UProfContext *context;
+  UProfReport *report;
+  UProfSnapshot *snapshot;
+  UProfSnapshotContext *snapshot_context;
+  UProfSnapshotCounter *counter;
+  UProfSnapshotTimer *timer;
+  GArray *data;
+  int i;
+
+  uprof_init (&argc, &argv);
+
+  context = uprof_context_new ("Snapshot context");
+  report = uprof_report_new ("Snapshot report");
+  uprof_report_add_context (report, context);
+
+  for (i = 0; i < 3; i++)
+    UPROF_COUNTER_INC (context, snapshot_counter);
+  UPROF_TIMER_START (context, snapshot_timer);
+  UPROF_TIMER_STOP (context, snapshot_timer);
+
+  /* A full snapshot should survive a round trip through the parser */
+  _uprof_report_get_snapshot (report, &data, NULL);
+  snapshot = parse (data);
+
+  g_assert (!snapshot->delta);
+  g_assert (snapshot->counter_hz == uprof_get_system_counter_hz ());
+  g_assert (g_list_length (snapshot->contexts) == 1);
+  snapshot_context = snapshot->contexts->data;
+  g_assert (strcmp (snapshot_context->name, "Snapshot context") == 0);
+
+  counter = find_counter (snapshot, "Snapshot counter");
+  g_assert (counter && counter->count == 3);
+  /* The context isn't being sampled */
+  g_assert (!counter->rates.sampled && counter->rates.peak == 0);
+
+  timer = find_timer (snapshot, "Snapshot timer");
+  g_assert (timer && timer->count == 1 && timer->parent_name == NULL);
+  g_assert (timer->fastest <= timer->slowest);
+
+  uprof_snapshot_free (snapshot);
+
+  check_invalid_snapshots (data);
+  g_array_free (data, TRUE);
+
+  check_delta_snapshots (report, context);
+
+  uprof_report_unref (report);
+  uprof_context_unref (context);
+
+  return 0;
+}
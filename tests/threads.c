@@ -0,0 +1,113 @@
+
+#include <uprof.h>
+
+#include <stdio.h>
+
+#define UPROF_DEBUG     1
+
+#ifdef UPROF_DEBUG
+#define DBG_PRINTF(fmt, args...)              \
+  do                                          \
+    {                                         \
+      printf ("[%s] " fmt, __FILE__, ##args); \
+    }                                         \
+  while (0)
+#else
+#define DBG_PRINTF(fmt, args...) do { } while (0)
+#endif
+
+#define N_THREADS 4
+#define N_ITERATIONS 4
+
+UPROF_STATIC_TIMER (full_timer,
+                    NULL, /* no parent */
+                    "Full timer",
+                    "A timer for the whole test",
+                    0 /* no application private data */
+);
+
+UPROF_STATIC_TIMER (worker_timer,
+                    "Full timer", /* parent */
+                    "Worker timer",
+                    "A timer shared by all of the worker threads",
+                    0 /* no application private data */
+);
+
+UPROF_STATIC_COUNTER (worker_counter,
+                      "Worker counter",
+                      "A counter shared by all of the worker threads",
+                      0 /* no application private data */
+);
+
+static UProfContext *context;
+
+static gpointer
+worker_thread (gpointer user_data)
+{
+  int i;
+
+  for (i = 0; i < N_ITERATIONS; i++)
+    {
+      struct timespec delay;
+
+      UPROF_THREADED_COUNTER_INC (context, worker_counter);
+      UPROF_THREADED_TIMER_START (context, worker_timer);
+      delay.tv_sec = 0;
+      delay.tv_nsec = 1000000000/4;
+      nanosleep (&delay, NULL);
+      UPROF_THREADED_TIMER_STOP (context, worker_timer);
+    }
+
+  return NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  UProfReport *report;
+  GThread *threads[N_THREADS];
+  int i;
+
+  g_thread_init (NULL);
+  uprof_init (&argc, &argv);
+
+  context = uprof_context_new ("Threads context");
+  uprof_context_enable_timer_histograms (context);
+
+  /* Pass a filename to also save a trace viewable with chrome://tracing */
+  if (argc > 1)
+    uprof_context_enable_event_trace (context);
+
+  UPROF_TIMER_START (context, full_timer);
+
+  for (i = 0; i < N_THREADS; i++)
+    threads[i] = g_thread_create (worker_thread, NULL, TRUE, NULL);
+  for (i = 0; i < N_THREADS; i++)
+    g_thread_join (threads[i]);
+
+  UPROF_TIMER_STOP (context, full_timer);
+
+  DBG_PRINTF ("Expected result = Full timer ~1 second and Worker timer ~4 "
+              "seconds with a count of %d, Worker counter = %d:\n",
+              N_THREADS * N_ITERATIONS, N_THREADS * N_ITERATIONS);
+
+  report = uprof_report_new ("Threads report");
+  uprof_report_add_context (report, context);
+  uprof_report_print (report);
+  uprof_report_unref (report);
+
+  if (argc > 1)
+    {
+      GError *error = NULL;
+      if (!uprof_context_write_chrome_trace (context, argv[1], &error))
+        {
+          g_printerr ("Failed to write trace: %s\n", error->message);
+          g_error_free (error);
+        }
+    }
+
+  uprof_context_unref (context);
+
+  return 0;
+}
+
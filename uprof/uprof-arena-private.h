@@ -0,0 +1,44 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_ARENA_PRIVATE_H_
+#define _UPROF_ARENA_PRIVATE_H_
+
+#include <glib.h>
+
+/* A simple bump allocator. Memory allocated from an arena can't be
+ * freed individually; it is all freed at once with the arena. Arenas
+ * aren't thread safe. */
+typedef struct _UProfArena UProfArena;
+
+UProfArena *
+_uprof_arena_new (void);
+
+void
+_uprof_arena_free (UProfArena *arena);
+
+/* Returns zeroed memory; @alignment must be a power of two */
+gpointer
+_uprof_arena_alloc (UProfArena *arena, gsize size, gsize alignment);
+
+char *
+_uprof_arena_strdup (UProfArena *arena, const char *str);
+
+#endif /* _UPROF_ARENA_PRIVATE_H_ */
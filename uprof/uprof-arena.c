@@ -0,0 +1,114 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include <uprof-arena-private.h>
+
+#include <glib.h>
+
+#include <string.h>
+
+/* Allocations bigger than this get a chunk of their own */
+#define UPROF_ARENA_CHUNK_SIZE 4096
+
+typedef struct _UProfArenaChunk UProfArenaChunk;
+
+/* The chunk's memory directly follows this header */
+struct _UProfArenaChunk
+{
+  UProfArenaChunk *next;
+  gsize size;
+  gsize used;
+};
+
+struct _UProfArena
+{
+  /* The chunk currently being allocated from is first */
+  UProfArenaChunk *chunks;
+};
+
+UProfArena *
+_uprof_arena_new (void)
+{
+  return g_slice_new0 (UProfArena);
+}
+
+void
+_uprof_arena_free (UProfArena *arena)
+{
+  UProfArenaChunk *chunk;
+  UProfArenaChunk *next;
+
+  for (chunk = arena->chunks; chunk; chunk = next)
+    {
+      next = chunk->next;
+      g_free (chunk);
+    }
+
+  g_slice_free (UProfArena, arena);
+}
+
+static gpointer
+alloc_from_chunk (UProfArenaChunk *chunk, gsize size, gsize alignment)
+{
+  gsize data = GPOINTER_TO_SIZE (chunk + 1);
+  gsize start = (data + chunk->used + alignment - 1) & ~(alignment - 1);
+
+  if (start + size > data + chunk->size)
+    return NULL;
+
+  chunk->used = start + size - data;
+  return GSIZE_TO_POINTER (start);
+}
+
+gpointer
+_uprof_arena_alloc (UProfArena *arena, gsize size, gsize alignment)
+{
+  UProfArenaChunk *chunk = arena->chunks;
+  gpointer mem;
+  gsize chunk_size;
+
+  if (chunk && (mem = alloc_from_chunk (chunk, size, alignment)))
+    return mem;
+
+  /* Chunks are zeroed up front so allocations don't need clearing */
+  chunk_size = MAX (UPROF_ARENA_CHUNK_SIZE, size + alignment);
+  chunk = g_malloc0 (sizeof (UProfArenaChunk) + chunk_size);
+  chunk->size = chunk_size;
+  chunk->next = arena->chunks;
+  arena->chunks = chunk;
+
+  return alloc_from_chunk (chunk, size, alignment);
+}
+
+char *
+_uprof_arena_strdup (UProfArena *arena, const char *str)
+{
+  gsize len;
+  char *copy;
+
+  if (!str)
+    return NULL;
+
+  len = strlen (str) + 1;
+  copy = _uprof_arena_alloc (arena, len, 1);
+  memcpy (copy, str, len);
+
+  return copy;
+}
@@ -0,0 +1,54 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_CALL_GRAPH_PRIVATE_H_
+#define _UPROF_CALL_GRAPH_PRIVATE_H_
+
+#include <uprof-context.h>
+#include <uprof-timer.h>
+
+#include <glib.h>
+
+/* A node of the calling context tree merged from all threads for
+ * reporting. The root node has no timer. */
+typedef struct _UProfCallGraphNode
+{
+  UProfTimerState *timer;
+  unsigned long count;
+  guint64 total;
+  GList *children;
+} UProfCallGraphNode;
+
+/* Merges the call graphs recorded by each thread for the timers of
+ * @context and any linked contexts */
+UProfCallGraphNode *
+_uprof_call_graph_get_tree (UProfContext *context);
+
+void
+_uprof_call_graph_free_tree (UProfCallGraphNode *root);
+
+void
+_uprof_call_graph_reset_context (UProfContext *context);
+
+/* Detaches any call graph nodes that refer to the context's timers */
+void
+_uprof_call_graph_forget_context (UProfContext *context);
+
+#endif /* _UPROF_CALL_GRAPH_PRIVATE_H_ */
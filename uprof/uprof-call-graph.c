@@ -0,0 +1,397 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include <uprof.h>
+#include <uprof-context-private.h>
+#include <uprof-call-graph-private.h>
+
+#include <glib.h>
+
+#include <pthread.h>
+
+/* Deeper nesting is tolerated but not recorded */
+#define UPROF_CALL_GRAPH_MAX_DEPTH 64
+
+typedef struct _UProfCallNode UProfCallNode;
+
+/* Each thread records into its own calling context tree so recording
+ * doesn't need a lock. While a thread is running, nodes are only ever
+ * added, never freed, and a new node is fully initialized before it
+ * is linked into its parent's children so the trees can be walked
+ * while threads are adding to them. When a thread exits, its tree is
+ * merged into exited_root and freed.
+ *
+ * Only the owning thread writes count and total, so resetting a node
+ * instead records their current values as a baseline to subtract when
+ * reporting. The baselines are only accessed with the stacks lock
+ * held. */
+struct _UProfCallNode
+{
+  UProfTimerState *timer;
+  UProfCallNode *children;
+  UProfCallNode *next;
+
+  unsigned long count;
+  guint64 total;
+
+  unsigned long reset_count;
+  guint64 reset_total;
+};
+
+typedef struct
+{
+  UProfCallNode *node;
+  UProfTimerState *timer;
+  guint64 start;
+  guint64 suspended_at_start;
+} UProfCallFrame;
+
+typedef struct
+{
+  UProfCallNode root;
+  UProfCallFrame frames[UPROF_CALL_GRAPH_MAX_DEPTH];
+  int depth;
+} UProfCallStack;
+
+int _uprof_call_graph_enabled;
+
+static __thread UProfCallStack *thread_stack;
+
+/* Only used so we find out when a thread exits */
+static pthread_key_t stack_key;
+static pthread_once_t stack_key_once = PTHREAD_ONCE_INIT;
+
+G_LOCK_DEFINE_STATIC (stacks);
+static GList *stacks;
+
+/* The combined trees of all the threads that have exited. This is only
+ * accessed with the stacks lock held. */
+static UProfCallNode exited_root;
+
+static UProfCallNode *
+add_node (UProfCallNode *parent, UProfTimerState *timer)
+{
+  UProfCallNode *node = g_slice_new0 (UProfCallNode);
+
+  node->timer = timer;
+  node->next = parent->children;
+
+  __sync_synchronize ();
+  parent->children = node;
+
+  return node;
+}
+
+/* Moves the counts of all the descendants of @src into @dest and frees
+ * them */
+static void
+merge_exited_nodes (UProfCallNode *dest, UProfCallNode *src)
+{
+  UProfCallNode *child;
+  UProfCallNode *next;
+
+  for (child = src->children; child; child = next)
+    {
+      UProfCallNode *merged;
+
+      next = child->next;
+
+      for (merged = dest->children; merged; merged = merged->next)
+        if (merged->timer == child->timer)
+          break;
+      if (!merged)
+        merged = add_node (dest, child->timer);
+
+      merged->count += child->count;
+      merged->total += child->total;
+      merged->reset_count += child->reset_count;
+      merged->reset_total += child->reset_total;
+
+      merge_exited_nodes (merged, child);
+      g_slice_free (UProfCallNode, child);
+    }
+
+  src->children = NULL;
+}
+
+static void
+thread_exited_cb (void *data)
+{
+  UProfCallStack *stack = data;
+
+  /* This runs in the exiting thread so in case it starts any more
+   * timers it will simply get a new stack */
+  thread_stack = NULL;
+
+  G_LOCK (stacks);
+  stacks = g_list_remove (stacks, stack);
+  merge_exited_nodes (&exited_root, &stack->root);
+  G_UNLOCK (stacks);
+
+  g_slice_free (UProfCallStack, stack);
+}
+
+static void
+create_stack_key (void)
+{
+  pthread_key_create (&stack_key, thread_exited_cb);
+}
+
+static UProfCallStack *
+add_thread_stack (void)
+{
+  UProfCallStack *stack = g_slice_new0 (UProfCallStack);
+
+  pthread_once (&stack_key_once, create_stack_key);
+  pthread_setspecific (stack_key, stack);
+
+  G_LOCK (stacks);
+  stacks = g_list_prepend (stacks, stack);
+  G_UNLOCK (stacks);
+
+  return stack;
+}
+
+void
+_uprof_call_graph_push (UProfTimerState *timer, guint64 timestamp)
+{
+  UProfCallStack *stack;
+  UProfCallFrame *frame;
+  UProfCallNode *parent;
+  UProfCallNode *node;
+
+  if (!timer->object.context->call_graph)
+    return;
+
+  stack = thread_stack;
+  if (G_UNLIKELY (!stack))
+    stack = thread_stack = add_thread_stack ();
+
+  if (G_UNLIKELY (stack->depth >= UPROF_CALL_GRAPH_MAX_DEPTH))
+    {
+      stack->depth++;
+      return;
+    }
+
+  parent = stack->depth ? stack->frames[stack->depth - 1].node : &stack->root;
+  for (node = parent->children; node; node = node->next)
+    if (node->timer == timer)
+      break;
+  if (G_UNLIKELY (!node))
+    node = add_node (parent, timer);
+
+  frame = &stack->frames[stack->depth++];
+  frame->node = node;
+  frame->timer = timer;
+  frame->start = timestamp;
+  frame->suspended_at_start =
+    _uprof_suspend_state_get_suspended_total (timer->object.suspend,
+                                              timestamp);
+}
+
+void
+_uprof_call_graph_pop (UProfTimerState *timer, guint64 timestamp)
+{
+  UProfCallStack *stack = thread_stack;
+  UProfCallFrame *frame;
+  int i;
+
+  if (!stack || stack->depth == 0)
+    return;
+
+  if (G_UNLIKELY (stack->depth > UPROF_CALL_GRAPH_MAX_DEPTH))
+    {
+      stack->depth--;
+      return;
+    }
+
+  /* Timers should be stopped in the reverse order they were started
+   * but if not we discard any frames left running above this one. If
+   * the timer isn't on the stack at all then it was started before its
+   * context's call graph was enabled. */
+  for (i = stack->depth - 1; i >= 0; i--)
+    if (stack->frames[i].timer == timer)
+      break;
+  if (i < 0)
+    return;
+
+  /* NB: time spent while the context was suspended is excluded */
+  frame = &stack->frames[i];
+  frame->node->count++;
+  frame->node->total += timestamp - frame->start -
+    (_uprof_suspend_state_get_suspended_total (timer->object.suspend,
+                                               timestamp) -
+     frame->suspended_at_start);
+
+  stack->depth = i;
+}
+
+typedef void (*UProfCallNodeCallback) (UProfCallNode *node,
+                                       gpointer user_data);
+
+static void
+foreach_node_recursive (UProfCallNode *node,
+                        UProfCallNodeCallback callback,
+                        gpointer user_data)
+{
+  UProfCallNode *child;
+
+  for (child = node->children; child; child = child->next)
+    {
+      callback (child, user_data);
+      foreach_node_recursive (child, callback, user_data);
+    }
+}
+
+static void
+foreach_node (UProfCallNodeCallback callback, gpointer user_data)
+{
+  GList *l;
+
+  G_LOCK (stacks);
+  for (l = stacks; l; l = l->next)
+    {
+      UProfCallStack *stack = l->data;
+      foreach_node_recursive (&stack->root, callback, user_data);
+    }
+  foreach_node_recursive (&exited_root, callback, user_data);
+  G_UNLOCK (stacks);
+}
+
+static void
+reset_node_cb (UProfCallNode *node, gpointer user_data)
+{
+  UProfContext *context = user_data;
+
+  if (node->timer && node->timer->object.context == context)
+    {
+      node->reset_count = node->count;
+      node->reset_total = node->total;
+    }
+}
+
+void
+_uprof_call_graph_reset_context (UProfContext *context)
+{
+  foreach_node (reset_node_cb, context);
+}
+
+static void
+forget_node_cb (UProfCallNode *node, gpointer user_data)
+{
+  UProfContext *context = user_data;
+
+  if (node->timer && node->timer->object.context == context)
+    node->timer = NULL;
+}
+
+void
+_uprof_call_graph_forget_context (UProfContext *context)
+{
+  foreach_node (forget_node_cb, context);
+}
+
+static void
+add_context_cb (UProfContext *context, gpointer user_data)
+{
+  GHashTable *contexts = user_data;
+  g_hash_table_insert (contexts, context, context);
+}
+
+static UProfCallGraphNode *
+get_merged_child (UProfCallGraphNode *parent, UProfTimerState *timer)
+{
+  UProfCallGraphNode *child;
+  GList *l;
+
+  for (l = parent->children; l; l = l->next)
+    {
+      child = l->data;
+      if (child->timer == timer)
+        return child;
+    }
+
+  child = g_slice_new0 (UProfCallGraphNode);
+  child->timer = timer;
+  parent->children = g_list_prepend (parent->children, child);
+
+  return child;
+}
+
+/* Nodes for timers that don't belong to one of the contexts being
+ * reported, including nodes whose timers were forgotten along with
+ * their context, are skipped over, so their children are merged into
+ * the nearest ancestor that does. */
+static void
+merge_children (UProfCallGraphNode *dest,
+                UProfCallNode *node,
+                GHashTable *contexts)
+{
+  UProfCallNode *child;
+
+  for (child = node->children; child; child = child->next)
+    {
+      UProfTimerState *timer = child->timer;
+
+      if (timer && g_hash_table_lookup (contexts, timer->object.context))
+        {
+          UProfCallGraphNode *merged = get_merged_child (dest, timer);
+
+          merged->count += child->count - child->reset_count;
+          merged->total += child->total - child->reset_total;
+          merge_children (merged, child, contexts);
+        }
+      else
+        merge_children (dest, child, contexts);
+    }
+}
+
+UProfCallGraphNode *
+_uprof_call_graph_get_tree (UProfContext *context)
+{
+  UProfCallGraphNode *root = g_slice_new0 (UProfCallGraphNode);
+  GHashTable *contexts = g_hash_table_new (NULL, NULL);
+  GList *l;
+
+  _uprof_context_for_self_and_links_recursive (context,
+                                               add_context_cb,
+                                               contexts);
+
+  G_LOCK (stacks);
+  for (l = stacks; l; l = l->next)
+    {
+      UProfCallStack *stack = l->data;
+      merge_children (root, &stack->root, contexts);
+    }
+  merge_children (root, &exited_root, contexts);
+  G_UNLOCK (stacks);
+
+  g_hash_table_destroy (contexts);
+
+  return root;
+}
+
+void
+_uprof_call_graph_free_tree (UProfCallGraphNode *root)
+{
+  g_list_foreach (root->children, (GFunc)_uprof_call_graph_free_tree, NULL);
+  g_list_free (root->children);
+  g_slice_free (UProfCallGraphNode, root);
+}
@@ -0,0 +1,134 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_CLOCK_H_
+#define _UPROF_CLOCK_H_
+
+#include <glib.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+G_BEGIN_DECLS
+
+/**
+ * uprof_get_system_counter:
+ *
+ * Gives direct access to the counter that uprof is using for timing.  On x86
+ * platforms with an invariant TSC this executes the rdtsc instruction to
+ * return a 64bit integer that increases at a constant rate. Otherwise it falls
+ * back to clock_gettime (CLOCK_MONOTONIC_RAW, &ts). See
+ * uprof_get_system_counter_source().
+ *
+ * Returns: a 64bit system counter
+ */
+guint64
+uprof_get_system_counter (void);
+
+/**
+ * uprof_get_system_counter_hz:
+ *
+ * Allows you to convert elapsed counts into seconds. Where possible the
+ * frequency of the TSC is read from cpuid or sysfs, otherwise it is estimated
+ * by comparing the TSC against CLOCK_MONOTONIC since uprof_init() was called.
+ * The estimate is refined until it has been measured over a quarter of a
+ * second so the value may change slightly during the first moments of a
+ * process. This doesn't sleep, although if called within 10 milliseconds of
+ * uprof_init() it will briefly spin.
+ *
+ * Returns: A factor that can be used to convert elapsed counts into seconds.
+ */
+guint64
+uprof_get_system_counter_hz (void);
+
+/**
+ * uprof_get_system_counter_source:
+ *
+ * Describes the clock that uprof_get_system_counter() is reading.
+ * The TSC is used on x86 if it runs at a constant rate across CPU
+ * frequency changes, sleep states and cores, otherwise and on other
+ * platforms clock_gettime() is used.
+ *
+ * Returns: A human readable description of the system counter
+ *
+ * Since: 0.4
+ */
+const char *
+uprof_get_system_counter_source (void);
+
+/**
+ * uprof_get_timer_overhead:
+ *
+ * Gives an estimate of how long a UPROF_TIMER_START() and
+ * UPROF_TIMER_STOP() pair takes, which is time that gets included in
+ * the total of any enclosing timer. This is measured once by
+ * uprof_init().
+ *
+ * Returns: The estimated overhead in system counter ticks; see
+ *          uprof_get_system_counter_hz()
+ *
+ * Since: 0.4
+ */
+guint64
+uprof_get_timer_overhead (void);
+
+/*< private >*/
+
+/* How the timer macros should read the system counter. This is
+ * chosen once by uprof_init() according to what the CPU supports and
+ * until then we simply call out to uprof_get_system_counter(). */
+typedef enum
+{
+  _UPROF_SYSTEM_COUNTER_MODE_DEFAULT,
+  _UPROF_SYSTEM_COUNTER_MODE_RDTSC_LFENCE,
+  _UPROF_SYSTEM_COUNTER_MODE_RDTSCP
+} _UProfSystemCounterMode;
+
+extern _UProfSystemCounterMode _uprof_system_counter_mode;
+
+/* This is used by the timer macros to avoid a library call for each
+ * sample. Both rdtscp and lfence + rdtsc wait for all earlier
+ * instructions to complete before reading the counter so we don't
+ * mis-measure short intervals due to out-of-order execution. */
+static inline guint64
+_uprof_get_system_counter_inline (void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+  if (G_LIKELY (_uprof_system_counter_mode ==
+                _UPROF_SYSTEM_COUNTER_MODE_RDTSCP))
+    {
+      unsigned int aux;
+      return __rdtscp (&aux);
+    }
+  else if (_uprof_system_counter_mode ==
+           _UPROF_SYSTEM_COUNTER_MODE_RDTSC_LFENCE)
+    {
+      __asm__ __volatile__ ("lfence" ::: "memory");
+      return __rdtsc ();
+    }
+#endif
+
+  return uprof_get_system_counter ();
+}
+
+G_END_DECLS
+
+#endif /* _UPROF_CLOCK_H_ */
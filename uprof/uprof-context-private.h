@@ -21,6 +21,10 @@
 #ifndef _UPROF_CONTEXT_PRIVATE_H_
 #define _UPROF_CONTEXT_PRIVATE_H_
 
+#include <uprof-object-state.h>
+#include <uprof-sampler-private.h>
+#include <uprof-arena-private.h>
+
 #include <glib.h>
 
 struct _UProfContext
@@ -29,16 +33,46 @@ struct _UProfContext
 
   guint  ref;
 
-  char	*name;
+  /* Interned */
+  const char *name;
+
+  /* The context's timer and counter states, their descriptions and
+   * locations and the context's options are all allocated from here
+   * while holding the objects lock. See _uprof_context_lock_objects() */
+  UProfArena *arena;
 
   GList *links;
 
+  /* A cache of this context and all the contexts recursively linked
+   * to it, valid while link_closure_age matches the global links age */
+  GList *link_closure;
+  guint link_closure_age;
+
   GList *statistics_groups;
 
   GList	*counters;
   GList	*timers;
 
-  int disabled;
+  /* Indexes of the above lists by name */
+  GHashTable *counters_by_name;
+  GHashTable *timers_by_name;
+
+  UProfSuspendState suspend;
+
+  /* The system counter when the context was created or last reset so
+   * we can report call rates */
+  guint64 reset_time;
+
+  /* Bumped each time the context is reset so that delta snapshots can
+   * tell when their baseline values no longer apply */
+  guint reset_generation;
+
+  gboolean timer_histograms;
+  gboolean event_trace;
+  gboolean call_graph;
+
+  /* Only set while the context is being sampled */
+  UProfSampler *sampler;
 
   gboolean resolved;
   GList *root_timers;
@@ -63,6 +97,18 @@ _uprof_context_for_self_and_links_recursive (UProfContext *context,
 void
 _uprof_context_reset (UProfContext *context);
 
+/* Discards any recorded timer events that refer to the context */
+void
+_uprof_event_trace_forget_context (UProfContext *context);
+
+/* Held while timers and counters are added to any context so other
+ * threads can safely walk the counters and timers lists */
+void
+_uprof_context_lock_objects (void);
+
+void
+_uprof_context_unlock_objects (void);
+
 typedef void (*UProfContextTraceMessageCallback) (UProfContext *context,
                                                   const char *message,
                                                   void *user_data);
@@ -27,6 +27,7 @@
 #include <uprof-timer-result.h>
 #include <uprof-timer-result-private.h>
 #include <uprof-counter-result-private.h>
+#include <uprof-call-graph-private.h>
 
 #include <glib.h>
 
@@ -39,6 +40,15 @@ typedef enum
   UPROF_CONTEXT_OPTION_TYPE_COUNT
 } UProfContextOptionType;
 
+/* Timers and counters are registered lazily the first time they are
+ * used which may happen concurrently if using the threaded macros */
+G_LOCK_DEFINE_STATIC (objects);
+
+/* Bumped whenever any context is linked or unlinked so we know when
+ * the cached link closures of contexts need to be rebuilt. Starts at 1
+ * so new contexts always start with an invalid closure. */
+static guint links_age = 1;
+
 typedef struct
 {
   UProfContextOptionType type;
@@ -64,7 +74,13 @@ uprof_context_new (const char *name)
   UProfContext *context = g_new0 (UProfContext, 1);
   context->ref = 1;
 
-  context->name = g_strdup (name);
+  context->name = g_intern_string (name);
+  context->arena = _uprof_arena_new ();
+  context->reset_time = uprof_get_system_counter ();
+
+  /* NB: the keys are owned by the object states */
+  context->counters_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+  context->timers_by_name = g_hash_table_new (g_str_hash, g_str_equal);
 
   _uprof_all_contexts = g_list_prepend (_uprof_all_contexts, context);
   return context;
@@ -77,21 +93,6 @@ uprof_context_ref (UProfContext *context)
   return context;
 }
 
-static void
-_uprof_context_free_options (UProfContext *context)
-{
-  GList *l;
-  for (l = context->options; l; l = l->next)
-    {
-      UProfContextOption *option = l->data;
-      g_free (option->name);
-      g_free (option->name_formatted);
-      g_free (option->description);
-      g_slice_free (UProfContextOption, option);
-    }
-  g_list_free (context->options);
-}
-
 void
 uprof_context_unref (UProfContext *context)
 {
@@ -99,24 +100,29 @@ uprof_context_unref (UProfContext *context)
   if (!context->ref)
     {
       GList *l;
-      g_free (context->name);
+
+      uprof_context_disable_event_trace (context);
+      _uprof_event_trace_forget_context (context);
+
+      uprof_context_disable_call_graph (context);
+      _uprof_call_graph_forget_context (context);
+
+      uprof_context_stop_sampling (context);
 
       for (l = context->counters; l != NULL; l = l->next)
-        {
-          _uprof_object_state_dispose (l->data);
-          g_slice_free (UProfCounterState, l->data);
-        }
+        _uprof_object_state_dispose (l->data);
       g_list_free (context->counters);
+      g_hash_table_destroy (context->counters_by_name);
 
       for (l = context->timers; l != NULL; l = l->next)
         {
           UProfTimerState *timer = l->data;
           _uprof_object_state_dispose (l->data);
-          if (timer->parent && timer->parent_name)
-            g_free (timer->parent_name);
-          g_slice_free (UProfTimerState, l->data);
+          _uprof_timer_result_free_histogram (timer);
+          g_list_free (timer->children);
         }
       g_list_free (context->timers);
+      g_hash_table_destroy (context->timers_by_name);
 
       for (l = context->report_messages; l != NULL; l = l->next)
         g_free (l->data);
@@ -125,8 +131,12 @@ uprof_context_unref (UProfContext *context)
       for (l = context->links; l != NULL; l = l->next)
         uprof_context_unref (l->data);
       g_list_free (context->links);
+      g_list_free (context->link_closure);
+
+      g_list_free (context->options);
 
-      _uprof_context_free_options (context);
+      /* Frees all the timer and counter states in one go */
+      _uprof_arena_free (context->arena);
 
       _uprof_all_contexts = g_list_remove (_uprof_all_contexts, context);
       g_free (context);
@@ -139,51 +149,74 @@ uprof_context_get_name (UProfContext *context)
   return context->name;
 }
 
-UProfObjectState *
-find_uprof_object_state (GList *objects, const char *name)
-{
-  GList *l;
-  for (l = objects; l != NULL; l = l->next)
-    if (strcmp (((UProfObjectState *)l->data)->name, name) == 0)
-      return l->data;
-  return NULL;
-}
-
 UProfTimerResult *
 uprof_context_get_timer_result (UProfContext *context, const char *name)
 {
-  return (UProfTimerResult *)find_uprof_object_state (context->timers, name);
+  UProfTimerResult *timer;
+
+  /* NB: other threads may be adding timers to the index or merging
+   * thread states concurrently */
+  G_LOCK (objects);
+
+  timer = g_hash_table_lookup (context->timers_by_name, name);
+  if (timer)
+    _uprof_timer_result_merge_thread_states (timer);
+
+  G_UNLOCK (objects);
+
+  return timer;
 }
 
 UProfCounterResult *
 uprof_context_get_counter_result (UProfContext *context, const char *name)
 {
-  return (UProfCounterResult *)find_uprof_object_state (context->counters,
-                                                        name);
-}
+  UProfCounterResult *counter;
 
-typedef struct
-{
-  GList *seen_contexts;
-  UProfContextCallback callback;
-  void *user_data;
-} ForContextAndLinksState;
+  G_LOCK (objects);
+
+  counter = g_hash_table_lookup (context->counters_by_name, name);
+  if (counter)
+    _uprof_counter_result_merge_thread_states (counter);
+
+  G_UNLOCK (objects);
+
+  return counter;
+}
 
 static void
-for_self_and_links_recursive (UProfContext *context,
-                              ForContextAndLinksState *state)
+build_link_closure_recursive (UProfContext *context,
+                              GHashTable *seen_contexts,
+                              GList **closure)
 {
   GList *l;
 
-  if (g_list_find (state->seen_contexts, context))
+  if (g_hash_table_lookup (seen_contexts, context))
     return;
 
-  state->callback (context, state->user_data);
-
-  state->seen_contexts = g_list_prepend (state->seen_contexts, context);
+  g_hash_table_insert (seen_contexts, context, context);
+  *closure = g_list_prepend (*closure, context);
 
   for (l = context->links; l; l = l->next)
-    for_self_and_links_recursive (l->data, state);
+    build_link_closure_recursive (l->data, seen_contexts, closure);
+}
+
+static GList *
+get_link_closure (UProfContext *context)
+{
+  if (G_UNLIKELY (context->link_closure_age != links_age))
+    {
+      GHashTable *seen_contexts = g_hash_table_new (NULL, NULL);
+      GList *closure = NULL;
+
+      build_link_closure_recursive (context, seen_contexts, &closure);
+      g_hash_table_destroy (seen_contexts);
+
+      g_list_free (context->link_closure);
+      context->link_closure = g_list_reverse (closure);
+      context->link_closure_age = links_age;
+    }
+
+  return context->link_closure;
 }
 
 /* This recursively traverses all the contexts linked to the given
@@ -193,15 +226,10 @@ _uprof_context_for_self_and_links_recursive (UProfContext *context,
                                              UProfContextCallback callback,
                                              void *user_data)
 {
-  ForContextAndLinksState state;
-
-  state.seen_contexts = NULL;
-  state.callback = callback;
-  state.user_data = user_data;
-
-  for_self_and_links_recursive (context, &state);
+  GList *l;
 
-  g_list_free (state.seen_contexts);
+  for (l = get_link_closure (context); l; l = l->next)
+    callback (l->data, user_data);
 }
 
 static void
@@ -222,13 +250,28 @@ _uprof_context_dirty_resolved_state (UProfContext *context)
                                                NULL);
 }
 
+void
+_uprof_context_lock_objects (void)
+{
+  G_LOCK (objects);
+}
+
+void
+_uprof_context_unlock_objects (void)
+{
+  G_UNLOCK (objects);
+}
+
 void
 uprof_context_add_counter (UProfContext *context, UProfCounter *counter)
 {
+  UProfCounterState *state;
+
+  G_LOCK (objects);
+
   /* We check if we have actually seen this counter before; it might be that
    * it belongs to a dynamic shared object that has been reloaded */
-  UProfCounterState *state =
-    uprof_context_get_counter_result (context, counter->name);
+  state = g_hash_table_lookup (context->counters_by_name, counter->name);
 
   /* If we have seen this counter before see if it is being added from a
    * new location and track that location if so.
@@ -242,7 +285,7 @@ uprof_context_add_counter (UProfContext *context, UProfCounter *counter)
     }
   else
     {
-      state = g_slice_alloc0 (sizeof (UProfCounterState));
+      state = _uprof_object_state_alloc (context, sizeof (UProfCounterState));
       _uprof_object_state_init (UPROF_OBJECT_STATE (state),
                                 context,
                                 counter->name,
@@ -251,20 +294,26 @@ uprof_context_add_counter (UProfContext *context, UProfCounter *counter)
                                         counter->filename,
                                         counter->line,
                                         counter->function);
-      state->disabled = context->disabled;
       context->counters = g_list_prepend (context->counters, state);
+      g_hash_table_insert (context->counters_by_name,
+                           (char *)state->object.name, state);
     }
   counter->state = state;
   _uprof_context_dirty_resolved_state (context);
+
+  G_UNLOCK (objects);
 }
 
 void
 uprof_context_add_timer (UProfContext *context, UProfTimer *timer)
 {
+  UProfTimerState *state;
+
+  G_LOCK (objects);
+
   /* We check if we have actually seen this timer before; it might be that
    * it belongs to a dynamic shared object that has been reloaded */
-  UProfTimerState *state =
-    uprof_context_get_timer_result (context, timer->name);
+  state = g_hash_table_lookup (context->timers_by_name, timer->name);
 
   /* If we have seen this timer before see if it is being added from a
    * new location and track that location if so.
@@ -278,23 +327,105 @@ uprof_context_add_timer (UProfContext *context, UProfTimer *timer)
     }
   else
     {
-      state = g_slice_alloc0 (sizeof (UProfTimerState));
+      state = _uprof_object_state_alloc (context, sizeof (UProfTimerState));
       _uprof_object_state_init (UPROF_OBJECT_STATE (state),
                                 context,
                                 timer->name,
                                 timer->description);
+      state->suspend = state->object.suspend;
       _uprof_object_state_add_location (UPROF_OBJECT_STATE (state),
                                         timer->filename,
                                         timer->line,
                                         timer->function);
 
-      state->disabled = context->disabled;
+      if (context->timer_histograms)
+        _uprof_timer_result_enable_histogram (state);
       if (timer->parent_name)
-        state->parent_name = g_strdup (timer->parent_name);
+        state->parent_name = g_intern_string (timer->parent_name);
       context->timers = g_list_prepend (context->timers, state);
+      g_hash_table_insert (context->timers_by_name,
+                           (char *)state->object.name, state);
     }
   timer->state = state;
   _uprof_context_dirty_resolved_state (context);
+
+  G_UNLOCK (objects);
+}
+
+void
+uprof_context_enable_timer_histograms (UProfContext *context)
+{
+  GList *l;
+
+  G_LOCK (objects);
+
+  context->timer_histograms = TRUE;
+  for (l = context->timers; l; l = l->next)
+    _uprof_timer_result_enable_histogram (l->data);
+
+  G_UNLOCK (objects);
+}
+
+void
+uprof_context_enable_event_trace (UProfContext *context)
+{
+  if (!context->event_trace)
+    {
+      context->event_trace = TRUE;
+      g_atomic_int_inc (&_uprof_event_trace_enabled);
+    }
+}
+
+void
+uprof_context_disable_event_trace (UProfContext *context)
+{
+  if (context->event_trace)
+    {
+      context->event_trace = FALSE;
+      g_atomic_int_add (&_uprof_event_trace_enabled, -1);
+    }
+}
+
+void
+uprof_context_enable_call_graph (UProfContext *context)
+{
+  if (!context->call_graph)
+    {
+      context->call_graph = TRUE;
+      g_atomic_int_inc (&_uprof_call_graph_enabled);
+    }
+}
+
+void
+uprof_context_disable_call_graph (UProfContext *context)
+{
+  if (context->call_graph)
+    {
+      context->call_graph = FALSE;
+      g_atomic_int_add (&_uprof_call_graph_enabled, -1);
+    }
+}
+
+void
+uprof_context_start_sampling (UProfContext *context,
+                              guint interval_msecs,
+                              guint n_samples)
+{
+  g_return_if_fail (interval_msecs > 0);
+  g_return_if_fail (n_samples >= 2);
+
+  uprof_context_stop_sampling (context);
+  context->sampler = _uprof_sampler_new (context, interval_msecs, n_samples);
+}
+
+void
+uprof_context_stop_sampling (UProfContext *context)
+{
+  if (context->sampler)
+    {
+      _uprof_sampler_free (context->sampler);
+      context->sampler = NULL;
+    }
 }
 
 void
@@ -304,6 +435,7 @@ uprof_context_link (UProfContext *context, UProfContext *other)
     {
       context->links = g_list_prepend (context->links,
                                        uprof_context_ref (other));
+      links_age++;
 
       _uprof_context_dirty_resolved_state (context);
     }
@@ -317,6 +449,7 @@ uprof_context_unlink (UProfContext *context, UProfContext *other)
     {
       uprof_context_unref (other);
       context->links = g_list_delete_link (context->links, l);
+      links_age++;
       _uprof_context_dirty_resolved_state (context);
     }
 }
@@ -369,6 +502,8 @@ uprof_context_foreach_timer (UProfContext            *context,
    */
   /* XXX: may want a dirty flag mechanism to avoid repeating this
    * too often! */
+  G_LOCK (objects);
+
   if (context->links)
     {
       _uprof_context_for_self_and_links_recursive (context,
@@ -377,7 +512,7 @@ uprof_context_foreach_timer (UProfContext            *context,
       timers = all_timers;
     }
   else
-    timers = context->timers;
+    timers = all_timers = g_list_copy (context->timers);
 
 #ifdef DEBUG_TIMER_HEIRACHY
   g_print (" all combined timers:\n");
@@ -385,12 +520,19 @@ uprof_context_foreach_timer (UProfContext            *context,
     g_print ("  timer->name: %s\n", ((UProfObjectState *)l->data)->name);
 #endif
 
+  /* NB: Merging has to be serialized with threads zeroing counters
+   * and other threads generating reports */
+  for (l = timers; l != NULL; l = l->next)
+    _uprof_timer_result_merge_thread_states (l->data);
+
+  G_UNLOCK (objects);
+
   if (sort_compare_func)
     timers = g_list_sort_with_data (timers, sort_compare_func, data);
   for (l = timers; l != NULL; l = l->next)
     callback (l->data, data);
 
-  g_list_free (all_timers);
+  g_list_free (timers);
 }
 
 static void
@@ -421,6 +563,8 @@ uprof_context_foreach_counter (UProfContext              *context,
    * a flat list of counters we can sort... */
   /* XXX: may want a dirty flag mechanism to avoid repeating this
    * too often! */
+  G_LOCK (objects);
+
   if (context->links)
     {
       _uprof_context_for_self_and_links_recursive (context,
@@ -429,14 +573,19 @@ uprof_context_foreach_counter (UProfContext              *context,
       counters = all_counters;
     }
   else
-    counters = context->counters;
+    counters = all_counters = g_list_copy (context->counters);
+
+  for (l = counters; l != NULL; l = l->next)
+    _uprof_counter_result_merge_thread_states (l->data);
+
+  G_UNLOCK (objects);
 
   if (sort_compare_func)
     counters = g_list_sort_with_data (counters, sort_compare_func, data);
   for (l = counters; l != NULL; l = l->next)
     callback (l->data, data);
 
-  g_list_free (all_counters);
+  g_list_free (counters);
 }
 
 GList *
@@ -445,27 +594,13 @@ uprof_context_get_root_timer_results (UProfContext *context)
   return g_list_copy (context->root_timers);
 }
 
+/* NB: Suspending doesn't need to touch any timers or counters; they
+ * check their context's suspend state when they are updated. */
 static void
 _uprof_suspend_single_context (UProfContext *context)
 {
-  GList *l;
-
-  context->disabled++;
-
-  for (l = context->timers; l != NULL; l = l->next)
-    {
-      UProfTimerState *timer = l->data;
-
-      timer->disabled++;
-      if (timer->start && timer->disabled == 1)
-        {
-          timer->partial_duration +=
-            uprof_get_system_counter () - timer->start;
-        }
-    }
-
-  for (l = context->counters; l != NULL; l = l->next)
-    ((UProfCounterState *)l->data)->disabled++;
+  if (context->suspend.disabled++ == 0)
+    context->suspend.suspend_start = uprof_get_system_counter ();
 }
 
 void
@@ -480,23 +615,12 @@ uprof_context_suspend (UProfContext *context)
 static void
 _uprof_resume_single_context (UProfContext *context)
 {
-  GList *l;
-
-  context->disabled--;
-
-  for (l = context->timers; l != NULL; l = l->next)
-    {
-      UProfTimerState *timer = l->data;
-      timer->disabled--;
-      /* Handle resuming of timers... */
-      /* NB: any accumulated ->partial_duration will be added to the total
-       * when the timer is stopped. */
-      if (timer->start && timer->disabled == 0)
-        timer->start = uprof_get_system_counter ();
-    }
+  g_return_if_fail (context->suspend.disabled > 0);
 
-  for (l = context->counters; l != NULL; l = l->next)
-    ((UProfCounterState *)l->data)->disabled--;
+  if (context->suspend.disabled == 1)
+    context->suspend.suspended_total +=
+      uprof_get_system_counter () - context->suspend.suspend_start;
+  context->suspend.disabled--;
 }
 
 void
@@ -538,10 +662,31 @@ _uprof_context_reset (UProfContext *context)
 {
   GList *l;
 
+  /* NB: threads may be zeroing counters or merging thread states
+   * concurrently. We also merge before resetting so that samples
+   * already taken by other threads don't resurface after the reset. */
+  G_LOCK (objects);
+
   for (l = context->timers; l; l = l->next)
-    _uprof_timer_result_reset (l->data);
+    {
+      _uprof_timer_result_merge_thread_states (l->data);
+      _uprof_timer_result_reset (l->data);
+    }
   for (l = context->counters; l; l = l->next)
-    _uprof_counter_result_reset (l->data);
+    {
+      _uprof_counter_result_merge_thread_states (l->data);
+      _uprof_counter_result_reset (l->data);
+    }
+
+  G_UNLOCK (objects);
+
+  context->reset_time = uprof_get_system_counter ();
+  context->reset_generation++;
+
+  _uprof_call_graph_reset_context (context);
+
+  if (context->sampler)
+    _uprof_sampler_clear (context->sampler);
 }
 
 typedef struct
@@ -631,25 +776,35 @@ uprof_context_add_boolean_option (UProfContext *context,
                                   UProfContextBooleanOptionSetter setter,
                                   void *user_data)
 {
-  UProfContextOption *option = g_slice_new0 (UProfContextOption);
-
+  UProfContextOption *option;
+  UProfArena *arena = context->arena;
   GList *l;
+
+  /* NB: the arena and the list of options may be used by other
+   * threads adding options concurrently */
+  G_LOCK (objects);
+
   for (l = context->options; l; l = l->next)
     {
-      UProfContextOption *option = l->data;
+      option = l->data;
       if (strcmp (option->name, name) == 0)
         g_warning ("Duplicate boolean option %s", name);
     }
+
+  option = _uprof_arena_alloc (arena, sizeof (UProfContextOption),
+                               sizeof (gpointer));
   option->type = UPROF_CONTEXT_OPTION_TYPE_BOOLEAN;
-  option->group = g_strdup (group);
-  option->name = g_strdup (name);
-  option->name_formatted = g_strdup (name_formatted);
-  option->description = g_strdup (description);
+  option->group = _uprof_arena_strdup (arena, group);
+  option->name = _uprof_arena_strdup (arena, name);
+  option->name_formatted = _uprof_arena_strdup (arena, name_formatted);
+  option->description = _uprof_arena_strdup (arena, description);
   option->getter = getter;
   option->setter = setter;
   option->user_data = user_data;
 
   context->options = g_list_prepend (context->options, option);
+
+  G_UNLOCK (objects);
 }
 
 static UProfContextOption *
@@ -290,6 +290,149 @@ uprof_context_suspend (UProfContext *context);
 void
 uprof_context_resume (UProfContext *context);
 
+/**
+ * uprof_context_enable_timer_histograms:
+ * @context: A uprof context
+ *
+ * Enables tracking a histogram of sample durations for all the timers
+ * of @context so that reports can show percentile timings such as the
+ * 99th percentile, instead of only the total, fastest and slowest
+ * durations.
+ *
+ * This costs around 4KB of memory per timer but the histograms are
+ * allocated up front so stopping a timer never allocates. Once
+ * enabled timer histograms can't be disabled again for the lifetime
+ * of the context.
+ *
+ * Since: 0.4
+ */
+void
+uprof_context_enable_timer_histograms (UProfContext *context);
+
+/**
+ * uprof_context_enable_event_trace:
+ * @context: A uprof context
+ *
+ * Starts recording a begin and end event with a timestamp each time
+ * one of the timers of @context is started or stopped so you can see
+ * exactly when things happened relative to other threads, instead of
+ * only aggregated totals. The events can be saved with
+ * uprof_context_write_chrome_trace().
+ *
+ * Each thread records events into its own fixed size ring buffer
+ * without locking so only the most recent 65536 events of each thread
+ * are kept. The events of threads that have exited are only kept until
+ * the next time a trace is written.
+ *
+ * Since: 0.4
+ */
+void
+uprof_context_enable_event_trace (UProfContext *context);
+
+/**
+ * uprof_context_disable_event_trace:
+ * @context: A uprof context
+ *
+ * Stops recording timer events for @context. Events already recorded
+ * are kept and can still be written with
+ * uprof_context_write_chrome_trace().
+ *
+ * Since: 0.4
+ */
+void
+uprof_context_disable_event_trace (UProfContext *context);
+
+/**
+ * uprof_context_enable_call_graph:
+ * @context: A uprof context
+ *
+ * Starts attributing the time of each timer of @context to the chain
+ * of timers that were running when it was started, instead of only to
+ * the parent it was declared with. Each thread keeps a stack of its
+ * running timers and accumulates counts and totals into a tree of
+ * calling contexts, so a helper timed from three different callers
+ * shows up three times in the report's call graph, once under each
+ * caller.
+ *
+ * Timers of contexts that don't have call graphs enabled are left out
+ * of the call graph, and their children are attributed to the nearest
+ * enclosing timer that is included. Nesting deeper than 64 timers is
+ * not recorded.
+ *
+ * Since: 0.4
+ */
+void
+uprof_context_enable_call_graph (UProfContext *context);
+
+/**
+ * uprof_context_disable_call_graph:
+ * @context: A uprof context
+ *
+ * Stops recording the call graph of @context. What has already been
+ * recorded is still reported.
+ *
+ * Since: 0.4
+ */
+void
+uprof_context_disable_call_graph (UProfContext *context);
+
+/**
+ * uprof_context_start_sampling:
+ * @context: A uprof context
+ * @interval_msecs: How often to take a sample
+ * @n_samples: How many samples to keep, at least 2
+ *
+ * Starts recording the count of every counter and the total of every
+ * timer of @context every @interval_msecs milliseconds into a ring of
+ * the most recent @n_samples samples. Reports then include the latest,
+ * mean and peak rate per second of each counter and timer over that
+ * window along with a small chart of how the rates have been trending,
+ * so you can see rates over time without scraping and diffing reports.
+ *
+ * Samples are taken from a GLib timeout so the application must be
+ * running the default mainloop. Calling this again while sampling
+ * discards the samples taken so far. Resetting the report also
+ * discards any samples.
+ *
+ * Since: 0.4
+ */
+void
+uprof_context_start_sampling (UProfContext *context,
+                              guint interval_msecs,
+                              guint n_samples);
+
+/**
+ * uprof_context_stop_sampling:
+ * @context: A uprof context
+ *
+ * Stops sampling @context and frees the samples taken so far.
+ *
+ * Since: 0.4
+ */
+void
+uprof_context_stop_sampling (UProfContext *context);
+
+/**
+ * uprof_context_write_chrome_trace:
+ * @context: A uprof context
+ * @filename: The file to write
+ * @error: A #GError return location or %NULL
+ *
+ * Writes the timer events recorded for @context and any linked
+ * contexts, in the JSON trace event format understood by the
+ * chrome://tracing and Perfetto UIs. Each timer is shown with its
+ * name and its context's name as the category.
+ *
+ * Returns: %TRUE if the trace was written, else %FALSE and @error
+ *          is set
+ *
+ * Since: 0.4
+ */
+gboolean
+uprof_context_write_chrome_trace (UProfContext *context,
+                                  const char *filename,
+                                  GError **error);
+
 GList *
 uprof_context_get_root_timer_results (UProfContext *context);
 
@@ -24,4 +24,11 @@
 void
 _uprof_counter_result_reset (UProfCounterResult *counter);
 
+void
+_uprof_counter_result_merge_thread_state (UProfCounterResult *counter,
+                                          UProfCounterThreadState *thread_state);
+
+void
+_uprof_counter_result_merge_thread_states (UProfCounterResult *counter);
+
 #endif /* _UPROF_COUNTER_RESULT_PRIVATE_H_ */
@@ -19,6 +19,7 @@
  */
 
 #include <uprof-counter-result.h>
+#include <uprof-counter-result-private.h>
 
 #include <glib.h>
 
@@ -46,3 +47,25 @@ _uprof_counter_result_reset (UProfCounterResult *counter)
   counter->count = 0;
 }
 
+/* Sums the per-thread slots of counters updated using the
+ * UPROF_THREADED_COUNTER_ macros into the shared counter state. As
+ * with timers we only track what has already been merged so each
+ * thread's slot is only ever written by that thread. */
+void
+_uprof_counter_result_merge_thread_state (UProfCounterResult *counter,
+                                          UProfCounterThreadState *thread_state)
+{
+  unsigned long count = thread_state->count;
+
+  counter->count += count - thread_state->merged_count;
+  thread_state->merged_count = count;
+}
+
+void
+_uprof_counter_result_merge_thread_states (UProfCounterResult *counter)
+{
+  GSList *l;
+
+  for (l = counter->object.thread_states; l; l = l->next)
+    _uprof_counter_result_merge_thread_state (counter, l->data);
+}
@@ -19,9 +19,47 @@
  */
 
 #include "uprof-counter.h"
+#include "uprof-counter-result.h"
+#include "uprof-counter-result-private.h"
+#include "uprof-object-state-private.h"
+#include "uprof-context-private.h"
 
 #include <glib.h>
 
+void
+_uprof_counter_threaded_add (UProfCounterState *state, long delta)
+{
+  UProfCounterThreadState *thread_state;
+
+  if (G_UNLIKELY (state->object.suspend->disabled))
+    return;
+
+  thread_state =
+    _uprof_object_state_get_thread_state (UPROF_OBJECT_STATE (state),
+                                          sizeof (UProfCounterThreadState),
+                                          (UProfObjectThreadStateMergeFunc)
+                                          _uprof_counter_result_merge_thread_state);
+
+  /* NB: the count is unsigned so decrements simply wrap around and
+   * the modular arithmetic used to merge the slots still works */
+  thread_state->count += delta;
+}
+
+void
+_uprof_counter_threaded_zero (UProfCounterState *state)
+{
+  if (G_UNLIKELY (state->object.suspend->disabled))
+    return;
+
+  /* NB: other threads may be zeroing the same counter or merging it
+   * for a report so the merge and zero need to be done together
+   * under the objects lock */
+  _uprof_context_lock_objects ();
+  _uprof_counter_result_merge_thread_states (state);
+  state->count = 0;
+  _uprof_context_unlock_objects ();
+}
+
 gint
 _uprof_counter_compare_count (UProfCounterState *a,
                               UProfCounterState *b,
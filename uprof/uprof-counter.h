@@ -32,22 +32,20 @@ typedef struct _UProfCounterState
   /*< private >*/
   UProfObjectState  object;
 
-  gboolean          disabled;
-
+  /* Follows object.suspend so both fields the counter macros touch
+   * are in the same cache line, which is the whole state */
   unsigned long     count;
+} _UPROF_CACHE_LINE_ALIGNED UProfCounterState;
 
-  unsigned long padding0;
-  unsigned long padding1;
-  unsigned long padding2;
-  unsigned long padding3;
-  unsigned long padding4;
-  unsigned long padding5;
-  unsigned long padding6;
-  unsigned long padding7;
-  unsigned long padding8;
-  unsigned long padding9;
+typedef struct _UProfCounterThreadState
+{
+  /*< private >*/
+  unsigned long     count;
 
-} UProfCounterState;
+  /* The portion of count already merged into the shared
+   * UProfCounterState. Only touched while merging at report time. */
+  unsigned long     merged_count;
+} UProfCounterThreadState;
 
 
 typedef struct _UProfCounter
@@ -137,7 +135,7 @@ typedef struct _UProfCounter
   do { \
     if (!(COUNTER_SYMBOL).state) \
       _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL); \
-    if ((COUNTER_SYMBOL).state->disabled) \
+    if ((COUNTER_SYMBOL).state->object.suspend->disabled) \
       break; \
     (COUNTER_SYMBOL).state->count++; \
   } while (0)
@@ -152,8 +150,8 @@ typedef struct _UProfCounter
 #define UPROF_COUNTER_DEC(CONTEXT, COUNTER_SYMBOL) \
   do { \
     if (!(COUNTER_SYMBOL).state) \
-      _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL) \
-    if ((COUNTER_SYMBOL).state->disabled) \
+      _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL); \
+    if ((COUNTER_SYMBOL).state->object.suspend->disabled) \
       break; \
     (COUNTER_SYMBOL).state->count--; \
   } while (0)
@@ -168,12 +166,109 @@ typedef struct _UProfCounter
 #define UPROF_COUNTER_ZERO(CONTEXT, COUNTER_SYMBOL) \
   do { \
     if (!(COUNTER_SYMBOL).state) \
-      _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL) \
-    if ((COUNTER_SYMBOL).state->disabled) \
+      _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL); \
+    if ((COUNTER_SYMBOL).state->object.suspend->disabled) \
       break; \
     (COUNTER_SYMBOL).state->count = 0; \
   } while (0)
 
+void
+_uprof_counter_threaded_add (UProfCounterState *state, long delta);
+
+void
+_uprof_counter_threaded_zero (UProfCounterState *state);
+
+/**
+ * UPROF_THREADED_COUNTER_INC:
+ * @CONTEXT: A UProfContext
+ * @COUNTER_SYMBOL: A counter variable
+ *
+ * Increases the count for the given @COUNTER_SYMBOL like
+ * UPROF_COUNTER_INC() but is safe to use concurrently from multiple
+ * threads. Each thread increments its own cache line aligned slot so
+ * there is no contention between threads, and the slots are summed
+ * when iterating the counters of a context, such as when generating
+ * a report.
+ *
+ * Since: 0.4
+ */
+#define UPROF_THREADED_COUNTER_INC(CONTEXT, COUNTER_SYMBOL) \
+  do { \
+    if (!(COUNTER_SYMBOL).state) \
+      _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL); \
+    _uprof_counter_threaded_add ((COUNTER_SYMBOL).state, 1); \
+  } while (0)
+
+/**
+ * UPROF_THREADED_COUNTER_DEC:
+ * @CONTEXT: A UProfContext
+ * @COUNTER_SYMBOL: A counter variable
+ *
+ * Decreases the count for the given @COUNTER_SYMBOL. This is the
+ * thread safe equivalent of UPROF_COUNTER_DEC(); see
+ * UPROF_THREADED_COUNTER_INC().
+ *
+ * Since: 0.4
+ */
+#define UPROF_THREADED_COUNTER_DEC(CONTEXT, COUNTER_SYMBOL) \
+  do { \
+    if (!(COUNTER_SYMBOL).state) \
+      _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL); \
+    _uprof_counter_threaded_add ((COUNTER_SYMBOL).state, -1); \
+  } while (0)
+
+/**
+ * UPROF_THREADED_COUNTER_ZERO:
+ * @CONTEXT: A UProfContext
+ * @COUNTER_SYMBOL: A counter variable
+ *
+ * Resets the count for the given @COUNTER_SYMBOL. This is the
+ * threaded equivalent of UPROF_COUNTER_ZERO(). Increments made
+ * concurrently by other threads may or may not be included in the
+ * count that is discarded.
+ *
+ * Since: 0.4
+ */
+#define UPROF_THREADED_COUNTER_ZERO(CONTEXT, COUNTER_SYMBOL) \
+  do { \
+    if (!(COUNTER_SYMBOL).state) \
+      _UPROF_COUNTER_INIT_IF_UNSEEN (CONTEXT, COUNTER_SYMBOL); \
+    _uprof_counter_threaded_zero ((COUNTER_SYMBOL).state); \
+  } while (0)
+
+/* See the comment about UPROF_DISABLE in uprof-timer.h */
+#ifdef UPROF_DISABLE
+
+#define _UPROF_COUNTER_NOP(CONTEXT, COUNTER_SYMBOL) \
+  do { \
+    if (0) \
+      { \
+        (void)(CONTEXT); \
+        (void)(COUNTER_SYMBOL); \
+      } \
+  } while (0)
+
+#undef UPROF_COUNTER_INC
+#undef UPROF_COUNTER_DEC
+#undef UPROF_COUNTER_ZERO
+#undef UPROF_THREADED_COUNTER_INC
+#undef UPROF_THREADED_COUNTER_DEC
+#undef UPROF_THREADED_COUNTER_ZERO
+
+#define UPROF_COUNTER_INC(CONTEXT, COUNTER_SYMBOL) \
+  _UPROF_COUNTER_NOP (CONTEXT, COUNTER_SYMBOL)
+#define UPROF_COUNTER_DEC(CONTEXT, COUNTER_SYMBOL) \
+  _UPROF_COUNTER_NOP (CONTEXT, COUNTER_SYMBOL)
+#define UPROF_COUNTER_ZERO(CONTEXT, COUNTER_SYMBOL) \
+  _UPROF_COUNTER_NOP (CONTEXT, COUNTER_SYMBOL)
+#define UPROF_THREADED_COUNTER_INC(CONTEXT, COUNTER_SYMBOL) \
+  _UPROF_COUNTER_NOP (CONTEXT, COUNTER_SYMBOL)
+#define UPROF_THREADED_COUNTER_DEC(CONTEXT, COUNTER_SYMBOL) \
+  _UPROF_COUNTER_NOP (CONTEXT, COUNTER_SYMBOL)
+#define UPROF_THREADED_COUNTER_ZERO(CONTEXT, COUNTER_SYMBOL) \
+  _UPROF_COUNTER_NOP (CONTEXT, COUNTER_SYMBOL)
+
+#endif /* UPROF_DISABLE */
 
 gint
 _uprof_counter_compare_count (struct _UProfCounterState *a,
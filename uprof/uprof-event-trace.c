@@ -0,0 +1,328 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include <uprof.h>
+#include <uprof-context-private.h>
+
+#include <glib.h>
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Must be a power of two */
+#define UPROF_TRACE_RING_SIZE 65536
+
+typedef struct
+{
+  guint64 timestamp;
+  UProfContext *context;
+  UProfTimerState *timer;
+  _UProfTraceEventType type;
+} UProfTraceEvent;
+
+/* Each thread only ever appends to its own ring so recording doesn't
+ * need a lock. Only head is shared with whoever is reading the ring;
+ * we write each event before bumping head and readers discard any
+ * events that may have been overwritten while they were copying.
+ *
+ * Rings outlive their threads so that events recorded by threads that
+ * have since exited can still be written out. So that processes that
+ * keep starting new threads don't grow without bound, an exited
+ * thread's ring is freed once all of its events have been written out
+ * or belong to contexts that have since been destroyed. */
+typedef struct
+{
+  int tid;
+  volatile guint64 head;
+  UProfTraceEvent *events;
+  gboolean exited;
+} UProfTraceRing;
+
+int _uprof_event_trace_enabled;
+
+static __thread UProfTraceRing *thread_ring;
+
+/* Only used so we find out when a thread exits */
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+G_LOCK_DEFINE_STATIC (rings);
+static GList *rings;
+static int next_tid = 1;
+
+static void
+thread_exited_cb (void *data)
+{
+  UProfTraceRing *ring = data;
+
+  /* This runs in the exiting thread so in case it records any more
+   * events it will simply get a new ring */
+  thread_ring = NULL;
+
+  G_LOCK (rings);
+  ring->exited = TRUE;
+  G_UNLOCK (rings);
+}
+
+static void
+create_ring_key (void)
+{
+  pthread_key_create (&ring_key, thread_exited_cb);
+}
+
+static UProfTraceRing *
+add_thread_ring (void)
+{
+  UProfTraceRing *ring = g_slice_new0 (UProfTraceRing);
+
+  ring->events = g_new0 (UProfTraceEvent, UPROF_TRACE_RING_SIZE);
+
+  pthread_once (&ring_key_once, create_ring_key);
+  pthread_setspecific (ring_key, ring);
+
+  G_LOCK (rings);
+  ring->tid = next_tid++;
+  rings = g_list_prepend (rings, ring);
+  G_UNLOCK (rings);
+
+  return ring;
+}
+
+/* Checks whether all of the events in a ring either belong to a
+ * destroyed context or to one of the given contexts, which may be NULL
+ * if there are none. */
+static gboolean
+ring_events_are_spent (UProfTraceRing *ring, GHashTable *written_contexts)
+{
+  int i;
+
+  for (i = 0; i < UPROF_TRACE_RING_SIZE; i++)
+    {
+      UProfContext *context = ring->events[i].context;
+
+      if (context &&
+          (!written_contexts ||
+           !g_hash_table_lookup (written_contexts, context)))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Frees the rings of exited threads that don't have any events left
+ * that may still be written out. @written_contexts are the contexts
+ * whose events have just been written or %NULL.
+ *
+ * NB: Must be called with the rings lock held */
+static void
+free_exited_rings (GHashTable *written_contexts)
+{
+  GList *l;
+  GList *next;
+
+  for (l = rings; l; l = next)
+    {
+      UProfTraceRing *ring = l->data;
+
+      next = l->next;
+      if (ring->exited && ring_events_are_spent (ring, written_contexts))
+        {
+          g_free (ring->events);
+          g_slice_free (UProfTraceRing, ring);
+          rings = g_list_delete_link (rings, l);
+        }
+    }
+}
+
+void
+_uprof_event_trace_record (UProfTimerState *timer,
+                           _UProfTraceEventType type,
+                           guint64 timestamp)
+{
+  UProfContext *context = timer->object.context;
+  UProfTraceRing *ring;
+  UProfTraceEvent *event;
+
+  if (!context->event_trace)
+    return;
+
+  ring = thread_ring;
+  if (G_UNLIKELY (!ring))
+    ring = thread_ring = add_thread_ring ();
+
+  event = &ring->events[ring->head & (UPROF_TRACE_RING_SIZE - 1)];
+  event->timestamp = timestamp;
+  event->context = context;
+  event->timer = timer;
+  event->type = type;
+
+  __sync_synchronize ();
+  ring->head++;
+}
+
+void
+_uprof_event_trace_forget_context (UProfContext *context)
+{
+  GList *l;
+
+  G_LOCK (rings);
+
+  for (l = rings; l; l = l->next)
+    {
+      UProfTraceRing *ring = l->data;
+      int i;
+
+      for (i = 0; i < UPROF_TRACE_RING_SIZE; i++)
+        if (ring->events[i].context == context)
+          ring->events[i].context = NULL;
+    }
+
+  free_exited_rings (NULL);
+
+  G_UNLOCK (rings);
+}
+
+static void
+add_context_cb (UProfContext *context, gpointer user_data)
+{
+  GHashTable *contexts = user_data;
+  g_hash_table_insert (contexts, context, context);
+}
+
+static void
+append_json_string (GString *json, const char *str)
+{
+  const char *p;
+
+  g_string_append_c (json, '"');
+  for (p = str; *p; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        g_string_append_printf (json, "\\%c", *p);
+      else if ((guchar)*p < 0x20)
+        g_string_append_printf (json, "\\u%04x", (guchar)*p);
+      else
+        g_string_append_c (json, *p);
+    }
+  g_string_append_c (json, '"');
+}
+
+static void
+append_ring_events (GString *json,
+                    UProfTraceRing *ring,
+                    GHashTable *contexts,
+                    double usecs_per_tick,
+                    int pid,
+                    gboolean *first)
+{
+  UProfTraceEvent *events;
+  guint64 head;
+  guint64 copy_start;
+  guint64 start;
+  guint64 i;
+
+  head = ring->head;
+  __sync_synchronize ();
+  copy_start =
+    head > UPROF_TRACE_RING_SIZE ? head - UPROF_TRACE_RING_SIZE : 0;
+
+  events = g_new (UProfTraceEvent, head - copy_start);
+  for (i = copy_start; i < head; i++)
+    events[i - copy_start] = ring->events[i & (UPROF_TRACE_RING_SIZE - 1)];
+
+  /* The thread may have wrapped around and overwritten the oldest
+   * events while we were copying them. NB: while the thread is
+   * writing event ring->head it is also overwriting the slot of event
+   * ring->head - UPROF_TRACE_RING_SIZE. */
+  __sync_synchronize ();
+  start = copy_start;
+  if (ring->head + 1 > start + UPROF_TRACE_RING_SIZE)
+    start = MIN (head, ring->head + 1 - UPROF_TRACE_RING_SIZE);
+
+  for (i = start; i < head; i++)
+    {
+      UProfTraceEvent *event = &events[i - copy_start];
+      UProfTimerState *timer;
+
+      if (!event->context || !g_hash_table_lookup (contexts, event->context))
+        continue;
+
+      timer = event->timer;
+
+      if (!*first)
+        g_string_append (json, ",\n");
+      *first = FALSE;
+
+      g_string_append (json, "{\"name\":");
+      append_json_string (json, timer->object.name);
+      g_string_append (json, ",\"cat\":");
+      append_json_string (json, uprof_context_get_name (event->context));
+      g_string_append_printf (json,
+                              ",\"ph\":\"%c\",\"ts\":%.3f,"
+                              "\"pid\":%d,\"tid\":%d",
+                              event->type == _UPROF_TRACE_EVENT_BEGIN ?
+                              'B' : 'E',
+                              event->timestamp * usecs_per_tick,
+                              pid, ring->tid);
+      if (event->type == _UPROF_TRACE_EVENT_BEGIN && timer->parent_name)
+        {
+          g_string_append (json, ",\"args\":{\"parent\":");
+          append_json_string (json, timer->parent_name);
+          g_string_append_c (json, '}');
+        }
+      g_string_append_c (json, '}');
+    }
+
+  g_free (events);
+}
+
+gboolean
+uprof_context_write_chrome_trace (UProfContext *context,
+                                  const char *filename,
+                                  GError **error)
+{
+  GHashTable *contexts = g_hash_table_new (NULL, NULL);
+  GString *json = g_string_new ("{\"traceEvents\":[\n");
+  double usecs_per_tick = 1000000.0 / uprof_get_system_counter_hz ();
+  int pid = getpid ();
+  gboolean first = TRUE;
+  gboolean ret;
+  GList *l;
+
+  _uprof_context_for_self_and_links_recursive (context,
+                                               add_context_cb,
+                                               contexts);
+
+  G_LOCK (rings);
+  for (l = rings; l; l = l->next)
+    append_ring_events (json, l->data, contexts, usecs_per_tick, pid, &first);
+  free_exited_rings (contexts);
+  G_UNLOCK (rings);
+
+  g_string_append (json, "\n]}\n");
+
+  ret = g_file_set_contents (filename, json->str, json->len, error);
+
+  g_string_free (json, TRUE);
+  g_hash_table_destroy (contexts);
+
+  return ret;
+}
@@ -25,11 +25,18 @@
 
 typedef struct _UProfObjectLocation
 {
-  char  *filename;
-  long   line;
-  char  *function;
+  /* filename and function are interned */
+  const char *filename;
+  long        line;
+  const char *function;
 } UProfObjectLocation;
 
+/* Allocates zeroed, cache line aligned memory for a timer or counter
+ * state from the context's arena. The state is freed along with the
+ * context after calling _uprof_object_state_dispose(). */
+gpointer
+_uprof_object_state_alloc (UProfContext *context, gsize size);
+
 void
 _uprof_object_state_init (UProfObjectState *object,
                           UProfContext *context,
@@ -45,5 +52,16 @@ _uprof_object_state_add_location (UProfObjectState *object,
                                   unsigned long     line,
                                   const char       *function);
 
+/* Folds a thread's shard of state into the shared object state. This
+ * is called with the objects lock held when the thread exits, just
+ * before the shard is freed. */
+typedef void (*UProfObjectThreadStateMergeFunc) (UProfObjectState *object,
+                                                 gpointer thread_state);
+
+gpointer
+_uprof_object_state_get_thread_state (UProfObjectState *object,
+                                      gsize             size,
+                                      UProfObjectThreadStateMergeFunc merge);
+
 #endif /* _UPROF_OBJECT_STATE_PRIVATE_H_ */
 
@@ -20,11 +20,45 @@
 
 #include "uprof-object-state.h"
 #include "uprof-object-state-private.h"
+#include "uprof-context-private.h"
 
 #include <glib.h>
 
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 
+/* Each thread has a table of pointers to its own shards of object
+ * state indexed by UProfObjectState::thread_index. Indices are never
+ * re-used so a stale entry can never be confused with a different
+ * object. */
+static __thread gpointer *thread_states_table;
+static __thread int thread_states_table_size;
+
+/* Maps each thread_index back to its object so the shards of a thread
+ * can be merged and freed when the thread exits. The object is
+ * cleared when it is disposed. */
+typedef struct
+{
+  UProfObjectState *object;
+  UProfObjectThreadStateMergeFunc merge;
+} UProfThreadStateOwner;
+
+static GArray *thread_state_owners;
+static int next_thread_index = 1;
+
+/* Only used so we find out when a thread exits */
+static pthread_key_t thread_states_key;
+static pthread_once_t thread_states_key_once = PTHREAD_ONCE_INIT;
+
+G_LOCK_DEFINE_STATIC (thread_states);
+
+gpointer
+_uprof_object_state_alloc (UProfContext *context, gsize size)
+{
+  return _uprof_arena_alloc (context->arena, size, UPROF_CACHE_LINE_SIZE);
+}
+
 void
 _uprof_object_state_init (UProfObjectState *object,
                           UProfContext *context,
@@ -32,31 +66,34 @@ _uprof_object_state_init (UProfObjectState *object,
                           const char *description)
 {
   object->context = context;
-  object->name = g_strdup (name);
-  object->description = g_strdup (description);
+  object->name = g_intern_string (name);
+  object->description = _uprof_arena_strdup (context->arena, description);
   object->locations = NULL;
+  object->thread_index = 0;
+  object->thread_states = NULL;
+  object->suspend = &context->suspend;
 }
 
-void
-free_locations (GList *locations)
-{
-  GList *l;
-  for (l = locations; l != NULL; l = l->next)
-    {
-      UProfObjectLocation *location = l->data;
-      g_free (location->filename);
-      g_free (location->function);
-      g_slice_free (UProfObjectLocation, l->data);
-    }
-  g_list_free (locations);
-}
-
+/* NB: the object itself, its description and its locations belong to
+ * the context's arena and its names are interned */
 void
 _uprof_object_state_dispose (UProfObjectState *object)
 {
-  g_free (object->name);
-  g_free (object->description);
-  free_locations (object->locations);
+  g_list_free (object->locations);
+
+  /* NB: threads that are exiting may be freeing their shards */
+  G_LOCK (thread_states);
+
+  if (object->thread_index)
+    g_array_index (thread_state_owners,
+                   UProfThreadStateOwner,
+                   object->thread_index).object = NULL;
+
+  g_slist_foreach (object->thread_states, (GFunc)free, NULL);
+  g_slist_free (object->thread_states);
+  object->thread_states = NULL;
+
+  G_UNLOCK (thread_states);
 }
 
 /* A counter or timer may be accessed from multiple places in source
@@ -73,19 +110,145 @@ _uprof_object_state_add_location (UProfObjectState *object,
   GList *l;
   UProfObjectLocation *location;
 
+  /* Every object declared in the same function shares the same
+   * interned strings so we only need to compare pointers */
+  filename = g_intern_string (filename);
+  function = g_intern_string (function);
+
   for (l = object->locations; l != NULL; l = l->next)
     {
       location = l->data;
-      if (strcmp (location->filename, filename) == 0
+      if (location->filename == filename
           && location->line == line
-          && strcmp (location->function, function) == 0)
+          && location->function == function)
         return;
     }
 
-  location = g_slice_alloc (sizeof (UProfObjectLocation));
-  location->filename = g_strdup (filename);
+  location = _uprof_arena_alloc (object->context->arena,
+                                 sizeof (UProfObjectLocation),
+                                 sizeof (gpointer));
+  location->filename = filename;
   location->line = line;
-  location->function = g_strdup (function);
+  location->function = function;
   object->locations = g_list_prepend (object->locations, location);
 }
 
+/* Merges the shards of the exiting thread into their objects so
+ * memory use, and the cost of merging, doesn't grow with every thread
+ * that was ever created. */
+static void
+thread_exited_cb (void *data)
+{
+  int i;
+
+  _uprof_context_lock_objects ();
+  G_LOCK (thread_states);
+
+  for (i = 1; i < thread_states_table_size; i++)
+    {
+      gpointer thread_state = thread_states_table[i];
+      UProfThreadStateOwner *owner;
+
+      if (!thread_state)
+        continue;
+
+      /* If the object has been disposed then so has the shard */
+      owner = &g_array_index (thread_state_owners, UProfThreadStateOwner, i);
+      if (!owner->object)
+        continue;
+
+      owner->merge (owner->object, thread_state);
+      owner->object->thread_states =
+        g_slist_remove (owner->object->thread_states, thread_state);
+      free (thread_state);
+    }
+
+  G_UNLOCK (thread_states);
+  _uprof_context_unlock_objects ();
+
+  g_free (thread_states_table);
+  thread_states_table = NULL;
+  thread_states_table_size = 0;
+}
+
+static void
+create_thread_states_key (void)
+{
+  pthread_key_create (&thread_states_key, thread_exited_cb);
+}
+
+static gpointer
+add_thread_state (UProfObjectState *object,
+                  gsize size,
+                  UProfObjectThreadStateMergeFunc merge)
+{
+  gpointer thread_state;
+  int index;
+
+  size = (size + UPROF_CACHE_LINE_SIZE - 1) & ~(UPROF_CACHE_LINE_SIZE - 1);
+  if (posix_memalign (&thread_state, UPROF_CACHE_LINE_SIZE, size) != 0)
+    g_error ("Failed to allocate per-thread state for \"%s\"", object->name);
+  memset (thread_state, 0, size);
+
+  G_LOCK (thread_states);
+
+  if (!object->thread_index)
+    {
+      UProfThreadStateOwner *owner;
+
+      object->thread_index = next_thread_index++;
+
+      if (!thread_state_owners)
+        thread_state_owners = g_array_new (FALSE, TRUE,
+                                           sizeof (UProfThreadStateOwner));
+      g_array_set_size (thread_state_owners, next_thread_index);
+      owner = &g_array_index (thread_state_owners,
+                              UProfThreadStateOwner,
+                              object->thread_index);
+      owner->object = object;
+      owner->merge = merge;
+    }
+  object->thread_states = g_slist_prepend (object->thread_states,
+                                           thread_state);
+  index = object->thread_index;
+
+  G_UNLOCK (thread_states);
+
+  if (index >= thread_states_table_size)
+    {
+      int old_size = thread_states_table_size;
+
+      thread_states_table_size = MAX (index + 1, old_size * 2);
+      thread_states_table = g_renew (gpointer,
+                                     thread_states_table,
+                                     thread_states_table_size);
+      memset (thread_states_table + old_size, 0,
+              sizeof (gpointer) * (thread_states_table_size - old_size));
+
+      pthread_once (&thread_states_key_once, create_thread_states_key);
+      pthread_setspecific (thread_states_key, thread_states_table);
+    }
+
+  thread_states_table[index] = thread_state;
+
+  return thread_state;
+}
+
+/* Returns the calling thread's private shard of state for the given
+ * object, allocating a zeroed shard of @size bytes the first time a
+ * thread asks. It's up to the object type to merge shards at report
+ * time. Shards are freed along with the object, or when their thread
+ * exits after being folded into the object with @merge. */
+gpointer
+_uprof_object_state_get_thread_state (UProfObjectState *object,
+                                      gsize             size,
+                                      UProfObjectThreadStateMergeFunc merge)
+{
+  int index = object->thread_index;
+
+  if (G_LIKELY (index && index < thread_states_table_size &&
+                thread_states_table[index]))
+    return thread_states_table[index];
+
+  return add_thread_state (object, size, merge);
+}
@@ -30,26 +30,60 @@ typedef struct _UProfContext UProfContext;
 #define UPROF_CONTEXT_TYPEDEF
 #endif
 
+/* Every context has one of these to track when it is suspended.
+ * Instead of updating every timer when a context is suspended or
+ * resumed, timers snapshot the total time their context has been
+ * suspended when they start and subtract the difference when they
+ * stop. */
+typedef struct _UProfSuspendState
+{
+  /*< private >*/
+  int               disabled;
+  guint64           suspend_start;
+  guint64           suspended_total;
+} UProfSuspendState;
+
+/* Timer and counter states are allocated aligned to a cache line and
+ * laid out so that the fields the instrumentation macros touch share
+ * as few cache lines as possible. */
+#define UPROF_CACHE_LINE_SIZE 64
+
+#ifdef __GNUC__
+#define _UPROF_CACHE_LINE_ALIGNED \
+  __attribute__ ((aligned (UPROF_CACHE_LINE_SIZE)))
+#else
+#define _UPROF_CACHE_LINE_ALIGNED
+#endif
+
+static inline guint64
+_uprof_suspend_state_get_suspended_total (UProfSuspendState *suspend,
+                                          guint64 now)
+{
+  if (G_UNLIKELY (suspend->disabled))
+    return suspend->suspended_total + (now - suspend->suspend_start);
+  else
+    return suspend->suspended_total;
+}
+
 typedef struct _UProfObjectState
 {
   /*< private >*/
   UProfContext *context;
 
-  char  *name;
-  char  *description;
-  GList *locations;
-
-  unsigned long padding0;
-  unsigned long padding1;
-  unsigned long padding2;
-  unsigned long padding3;
-  unsigned long padding4;
-  unsigned long padding5;
-  unsigned long padding6;
-  unsigned long padding7;
-  unsigned long padding8;
-  unsigned long padding9;
+  /* Names are interned so they can be compared by pointer */
+  const char *name;
+  char       *description;
+  GList      *locations;
+
+  /* For objects updated via the threaded macros each thread gets its
+   * own shard of state; see _uprof_object_state_get_thread_state() */
+  int     thread_index;
+  GSList *thread_states;
 
+  /* Points to the suspend state of the object's context. This is
+   * last so that it shares a cache line with the first fields of
+   * the object type. */
+  UProfSuspendState *suspend;
 } UProfObjectState;
 
 G_END_DECLS
@@ -29,6 +29,23 @@ _uprof_report_get_text_report (UProfReport *report,
                                char **text_ret,
                                GError **error);
 gboolean
+_uprof_report_get_rates_report (UProfReport *report,
+                                char **text_ret,
+                                GError **error);
+
+gboolean
+_uprof_report_get_snapshot (UProfReport *report,
+                            GArray **snapshot_ret,
+                            GError **error);
+
+gboolean
+_uprof_report_get_snapshot_since (UProfReport *report,
+                                  guint32 cursor,
+                                  guint32 *cursor_ret,
+                                  GArray **snapshot_ret,
+                                  GError **error);
+
+gboolean
 _uprof_report_reset (UProfReport *report, GError **error);
 
 gboolean
@@ -23,6 +23,7 @@
 #include "uprof-dbus-private.h"
 #include "uprof-report-proxy.h"
 #include "uprof-report-proxy-private.h"
+#include "uprof-snapshot-private.h"
 
 #include <dbus/dbus-glib.h>
 #include <glib/gprintf.h>
@@ -184,6 +185,91 @@ uprof_report_proxy_get_text_report (UProfReportProxy *proxy,
   return text_report;
 }
 
+char *
+uprof_report_proxy_get_rates_report (UProfReportProxy *proxy,
+                                     GError **error)
+{
+  char *rates_report;
+
+  if (lost_connection (proxy, error))
+    return NULL;
+
+  if (!dbus_g_proxy_call_with_timeout (proxy->dbus_g_proxy,
+                                       "GetRatesReport",
+                                       1000,
+                                       error,
+                                       G_TYPE_INVALID,
+                                       G_TYPE_STRING, &rates_report,
+                                       G_TYPE_INVALID))
+    rates_report = NULL;
+
+  return rates_report;
+}
+
+UProfSnapshot *
+uprof_report_proxy_get_snapshot (UProfReportProxy *proxy,
+                                 GError **error)
+{
+  GArray *data;
+  UProfSnapshot *snapshot;
+
+  if (lost_connection (proxy, error))
+    return NULL;
+
+  if (!dbus_g_proxy_call_with_timeout (proxy->dbus_g_proxy,
+                                       "GetSnapshot",
+                                       1000,
+                                       error,
+                                       G_TYPE_INVALID,
+                                       DBUS_TYPE_G_UCHAR_ARRAY, &data,
+                                       G_TYPE_INVALID))
+    return NULL;
+
+  snapshot = _uprof_snapshot_parse ((const guint8 *)data->data,
+                                    data->len,
+                                    error);
+  g_array_free (data, TRUE);
+
+  return snapshot;
+}
+
+/* Each caller should start with a cursor of 0 and keep passing back
+ * whatever cursor we return to see what changed since their last
+ * snapshot, without resetting anything for other clients. */
+UProfSnapshot *
+uprof_report_proxy_get_snapshot_since (UProfReportProxy *proxy,
+                                       guint32 *cursor,
+                                       GError **error)
+{
+  GArray *data;
+  guint cursor_ret;
+  UProfSnapshot *snapshot;
+
+  if (lost_connection (proxy, error))
+    return NULL;
+
+  if (!dbus_g_proxy_call_with_timeout (proxy->dbus_g_proxy,
+                                       "GetSnapshotSince",
+                                       1000,
+                                       error,
+                                       G_TYPE_UINT, *cursor,
+                                       G_TYPE_INVALID,
+                                       G_TYPE_UINT, &cursor_ret,
+                                       DBUS_TYPE_G_UCHAR_ARRAY, &data,
+                                       G_TYPE_INVALID))
+    return NULL;
+
+  snapshot = _uprof_snapshot_parse ((const guint8 *)data->data,
+                                    data->len,
+                                    error);
+  g_array_free (data, TRUE);
+
+  if (snapshot)
+    *cursor = cursor_ret;
+
+  return snapshot;
+}
+
 gboolean
 uprof_report_proxy_reset (UProfReportProxy *proxy,
                           GError **error)
@@ -23,6 +23,8 @@
 
 #include <glib.h>
 
+#include <uprof-snapshot.h>
+
 G_BEGIN_DECLS
 
 /**
@@ -47,6 +49,19 @@ char *
 uprof_report_proxy_get_text_report (UProfReportProxy *proxy,
                                     GError **error);
 
+char *
+uprof_report_proxy_get_rates_report (UProfReportProxy *proxy,
+                                     GError **error);
+
+UProfSnapshot *
+uprof_report_proxy_get_snapshot (UProfReportProxy *proxy,
+                                 GError **error);
+
+UProfSnapshot *
+uprof_report_proxy_get_snapshot_since (UProfReportProxy *proxy,
+                                       guint32 *cursor,
+                                       GError **error);
+
 gboolean
 uprof_report_proxy_reset (UProfReportProxy *proxy,
                           GError **error);
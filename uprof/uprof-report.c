@@ -30,6 +30,8 @@
 #include "uprof-service-private.h"
 #include "uprof-report.h"
 #include "uprof-report-private.h"
+#include "uprof-snapshot-private.h"
+#include "uprof-call-graph-private.h"
 #include "uprof-reportable-glue.h"
 #include "uprof-dbus-private.h"
 
@@ -52,33 +54,35 @@ typedef struct
   int trace_messages_callback_id;
 } UProfReportContextReference;
 
-typedef struct _UProfReportRecord
+/* Report tables are rendered from a single buffer holding the text of
+ * every cell back to back. The buffer and the cell, row and column
+ * arrays belong to the report and are reused for each table so that
+ * generating a report doesn't need an allocation per cell. */
+typedef struct
 {
-  int    height;
-  GList *entries;
-  void  *data; /* timer / counter */
-} UProfReportRecord;
+  gsize offset; /* into UProfReportTable::text */
+  gsize len;
+  int   width;
+  int   height;
+} UProfReportCell;
 
-#if 0
-typedef enum
+typedef struct
 {
-  UPROF_ALIGNMENT_LEFT,
-  UPROF_ALIGNMENT_RIGHT,
-  UPROF_ALIGNMENT_CENTER
-} UProfAlignment;
-#endif
+  guint    first_cell;
+  int      height;
+  gboolean is_title;
+} UProfReportRow;
 
-typedef struct _UProfReportEntry
+typedef struct
 {
-  int            width;
-  int            height;
-#if 0
-  UProfAlignment alignment;
-#endif
-  gboolean       is_percentage;
-  float          percentage;
-  char         **lines;
-} UProfReportEntry;
+  GString *text;
+  GArray  *cells;
+  GArray  *rows;
+  GArray  *column_widths;
+
+  /* Where the text of the cell currently being added starts */
+  gsize    cell_start;
+} UProfReportTable;
 
 typedef struct _UProfAttribute
 {
@@ -107,6 +111,26 @@ typedef struct _UProfStatisticsGroup
 
 } UProfStatisticsGroup;
 
+/* Clients polling for delta snapshots are identified by a cursor and
+ * for each one we remember the values we last sent them, keyed by
+ * the UProfCounterResult or UProfTimerResult pointer. */
+#define UPROF_REPORT_MAX_SNAPSHOT_CURSORS 16
+
+typedef struct
+{
+  guint64 count;
+  guint64 total;
+
+  /* The reset_generation of the object's context */
+  guint reset_generation;
+} UProfSnapshotBaselineValue;
+
+typedef struct
+{
+  guint32 cursor;
+  GHashTable *values;
+} UProfSnapshotBaseline;
+
 struct _UProfReportPrivate
 {
   char *name;
@@ -123,6 +147,15 @@ struct _UProfReportPrivate
   GList *counter_attributes;
 
   int max_timer_name_size;
+
+  gboolean compensate_overhead;
+  guint n_top_self_timers;
+
+  GList *snapshot_baselines;
+  guint32 next_snapshot_cursor;
+
+  UProfReportTable table;
+  gsize last_report_len;
 };
 
 enum
@@ -256,6 +289,39 @@ free_statistics_group (UProfStatisticsGroup *group)
   g_slice_free (UProfStatisticsGroup, group);
 }
 
+static void
+free_snapshot_baseline_value (UProfSnapshotBaselineValue *value)
+{
+  g_slice_free (UProfSnapshotBaselineValue, value);
+}
+
+static void
+free_snapshot_baseline (UProfSnapshotBaseline *baseline)
+{
+  if (baseline->values)
+    g_hash_table_destroy (baseline->values);
+  g_slice_free (UProfSnapshotBaseline, baseline);
+}
+
+static void
+report_table_init (UProfReportTable *table)
+{
+  table->text = g_string_new (NULL);
+  table->cells = g_array_new (FALSE, FALSE, sizeof (UProfReportCell));
+  table->rows = g_array_new (FALSE, FALSE, sizeof (UProfReportRow));
+  table->column_widths = g_array_new (FALSE, TRUE, sizeof (int));
+  table->cell_start = 0;
+}
+
+static void
+report_table_destroy (UProfReportTable *table)
+{
+  g_string_free (table->text, TRUE);
+  g_array_free (table->cells, TRUE);
+  g_array_free (table->rows, TRUE);
+  g_array_free (table->column_widths, TRUE);
+}
+
 static void
 uprof_report_finalize (GObject *object)
 {
@@ -274,6 +340,12 @@ uprof_report_finalize (GObject *object)
   g_list_foreach (priv->timer_attributes, (GFunc)free_attribute, NULL);
   g_list_foreach (priv->counter_attributes, (GFunc)free_attribute, NULL);
 
+  g_list_foreach (priv->snapshot_baselines,
+                  (GFunc)free_snapshot_baseline, NULL);
+  g_list_free (priv->snapshot_baselines);
+
+  report_table_destroy (&priv->table);
+
   contexts = g_list_copy (priv->top_contexts);
   for (l = contexts; l; l = l->next)
     uprof_report_remove_context (report, l->data);
@@ -330,6 +402,15 @@ uprof_report_init (UProfReport *self)
   priv->counter_attributes = NULL;
 
   priv->max_timer_name_size = 0;
+
+  priv->compensate_overhead = FALSE;
+  priv->n_top_self_timers = 0;
+
+  priv->snapshot_baselines = NULL;
+  priv->next_snapshot_cursor = 1;
+
+  report_table_init (&priv->table);
+  priv->last_report_len = 0;
 }
 
 void
@@ -888,144 +969,238 @@ uprof_report_remove_timers_attribute (UProfReport *report,
     remove_attribute (report->priv->timer_attributes, attribute_name);
 }
 
-typedef struct
+static int
+utf8_width (const char *utf8_string, gsize len)
 {
-  UProfReport *report;
-  GList **records;
-} AddCounterState;
+  const char *end = utf8_string + len;
+  const char *p;
+  int width = 0;
+
+  for (p = utf8_string; p < end; p = g_utf8_next_char (p))
+    {
+      gunichar c = g_utf8_get_char (p);
+
+      if (g_unichar_iswide (c))
+        width += 2;
+      else if (!g_unichar_iszerowidth (c))
+        width++;
+    }
+
+  return width;
+}
 
 static void
-add_counter_record (UProfCounterResult *counter,
-                    gpointer            data)
+report_table_begin (UProfReportTable *table)
 {
-  AddCounterState        *state = data;
-  UProfReport            *report = state->report;
-  UProfReportPrivate     *priv = report->priv;
-  GList                 **records = state->records;
-  UProfReportRecord      *record;
-  UProfReportEntry       *entry;
-  char                   *lines;
-  GList                  *l;
+  g_string_truncate (table->text, 0);
+  g_array_set_size (table->cells, 0);
+  g_array_set_size (table->rows, 0);
+  g_array_set_size (table->column_widths, 0);
+}
+
+/* Title rows are followed by a blank line when the table is rendered */
+static void
+report_table_begin_row (UProfReportTable *table, gboolean is_title)
+{
+  UProfReportRow row;
+
+  row.first_cell = table->cells->len;
+  row.height = 0;
+  row.is_title = is_title;
+  g_array_append_val (table->rows, row);
+}
 
-  record = g_slice_new0 (UProfReportRecord);
+static void
+report_table_begin_cell (UProfReportTable *table)
+{
+  table->cell_start = table->text->len;
+}
 
-  entry = g_slice_new0 (UProfReportEntry);
-  lines = g_strdup_printf ("%s", uprof_counter_result_get_name (counter));
-  entry->lines = g_strsplit (lines, "\n", 0);
-  g_free (lines);
-  record->entries = g_list_prepend (record->entries, entry);
+/* Measures the text appended to table->text since the cell was begun
+ * so that column widths are known as soon as the last row is added */
+static void
+report_table_end_cell (UProfReportTable *table)
+{
+  UProfReportRow *row =
+    &g_array_index (table->rows, UProfReportRow, table->rows->len - 1);
+  guint column = table->cells->len - row->first_cell;
+  UProfReportCell cell;
+  const char *line;
+  const char *end;
+  int *column_width;
 
-  entry = g_slice_new0 (UProfReportEntry);
-  lines = g_strdup_printf ("%lu", uprof_counter_result_get_count (counter));
-  entry->lines = g_strsplit (lines, "\n", 0);
-  g_free (lines);
-  record->entries = g_list_prepend (record->entries, entry);
+  cell.offset = table->cell_start;
+  cell.len = table->text->len - table->cell_start;
+  cell.width = 0;
+  cell.height = 0;
 
-  for (l = priv->counter_attributes; l; l = l->next)
+  line = table->text->str + cell.offset;
+  end = line + cell.len;
+  for (;;)
     {
-      UProfAttribute *attribute = l->data;
-      UProfCountersAttributeCallback callback = attribute->callback;
-      entry = g_slice_new0 (UProfReportEntry);
-      lines = callback (report, counter, attribute->user_data);
-      entry->lines = g_strsplit (lines, "\n", 0);
-      g_free (lines);
-      record->entries = g_list_prepend (record->entries, entry);
+      const char *eol = memchr (line, '\n', end - line);
+
+      if (!eol)
+        eol = end;
+
+      cell.width = MAX (cell.width, utf8_width (line, eol - line));
+      cell.height++;
+
+      if (eol == end)
+        break;
+      line = eol + 1;
     }
 
-  record->entries = g_list_reverse (record->entries);
-  record->data = counter;
+  g_array_append_val (table->cells, cell);
+  row->height = MAX (row->height, cell.height);
 
-  *records = g_list_prepend (*records, record);
+  if (column >= table->column_widths->len)
+    g_array_set_size (table->column_widths, column + 1);
+  column_width = &g_array_index (table->column_widths, int, column);
+  *column_width = MAX (*column_width, cell.width);
 }
 
 static void
-prepare_report_records_for_counters (UProfReport *report,
-                                     UProfContext *context,
-                                     GList **records)
+report_table_add_cell (UProfReportTable *table, const char *text)
 {
-  AddCounterState state;
-  state.report = report;
-  state.records = records;
-  uprof_context_foreach_counter (context,
-                                 UPROF_COUNTER_SORT_COUNT_INC,
-                                 add_counter_record,
-                                 &state);
+  report_table_begin_cell (table);
+  g_string_append (table->text, text);
+  report_table_end_cell (table);
 }
 
-static int
-utf8_width (const char *utf8_string)
+static void
+report_table_add_cell_printf (UProfReportTable *table,
+                              const char *format,
+                              ...)
 {
-  glong n_chars;
-  gunichar *ucs4_string = g_utf8_to_ucs4_fast (utf8_string, -1, &n_chars);
-  int i;
-  int len = 0;
+  char buf[256];
+  va_list args;
+  int len;
 
-  for (i = 0; i < n_chars; i++)
+  va_start (args, format);
+  len = g_vsnprintf (buf, sizeof (buf), format, args);
+  va_end (args);
+
+  report_table_begin_cell (table);
+
+  /* Only cells too long for the stack buffer are formatted twice */
+  if (len < sizeof (buf))
+    g_string_append_len (table->text, buf, len);
+  else
     {
-      if (g_unichar_iswide (ucs4_string[i]))
-        len += 2;
-      else if (g_unichar_iszerowidth (ucs4_string[i]))
-        continue;
-      else
-        len++;
+      va_start (args, format);
+      g_string_append_vprintf (table->text, format, args);
+      va_end (args);
     }
 
-  g_free (ucs4_string);
+  report_table_end_cell (table);
+}
+
+static void
+append_padding (GString *buf, int n_spaces)
+{
+  static const char spaces[] = "                                ";
 
-  return len;
+  while (n_spaces > 0)
+    {
+      int len = MIN (n_spaces, sizeof (spaces) - 1);
+      g_string_append_len (buf, spaces, len);
+      n_spaces -= len;
+    }
 }
 
+/* Note: this consumes the table's cells as it goes, so a table can
+ * only be appended once. */
 static void
-append_record_entries (GString *buf, UProfReportRecord *record)
+report_table_append (UProfReportTable *table, GString *buf)
 {
-  int line;
-  GList *l;
+  const char *text = table->text->str;
+  guint i;
 
-  for (line = 0; line < record->height; line++)
+  for (i = 0; i < table->rows->len; i++)
     {
-      for (l = record->entries; l; l = l->next)
+      UProfReportRow *row = &g_array_index (table->rows, UProfReportRow, i);
+      UProfReportCell *cells =
+        &g_array_index (table->cells, UProfReportCell, row->first_cell);
+      guint n_cells;
+      int line;
+
+      if (i + 1 < table->rows->len)
+        n_cells = g_array_index (table->rows, UProfReportRow,
+                                 i + 1).first_cell - row->first_cell;
+      else
+        n_cells = table->cells->len - row->first_cell;
+
+      for (line = 0; line < row->height; line++)
         {
-          UProfReportEntry *entry = l->data;
-          if (entry->height < (line + 1))
-            g_string_append_printf (buf, "%-*s ", entry->width, "");
-          else
+          guint j;
+
+          for (j = 0; j < n_cells; j++)
             {
-              /* XXX: printf field widths are byte not character oriented
-               * so we have to consider multi-byte utf8 characters. */
-              int field_width =
-                strlen (entry->lines[line]) +
-                (entry->width - utf8_width (entry->lines[line]));
-              g_string_append_printf (buf, "%-*s ",
-                                      field_width, entry->lines[line]);
+              UProfReportCell *cell = &cells[j];
+              int column_width =
+                g_array_index (table->column_widths, int, j);
+              const char *start;
+              const char *eol;
+              gsize line_len;
+
+              if (cell->height <= line)
+                {
+                  append_padding (buf, column_width + 1);
+                  continue;
+                }
+
+              start = text + cell->offset;
+              eol = memchr (start, '\n', cell->len);
+              line_len = eol ? eol - start : cell->len;
+
+              g_string_append_len (buf, start, line_len);
+              append_padding (buf,
+                              column_width -
+                              utf8_width (start, line_len) + 1);
+
+              /* Move on to the cell's next line */
+              if (eol)
+                {
+                  cell->offset += line_len + 1;
+                  cell->len -= line_len + 1;
+                }
             }
+          g_string_append_c (buf, '\n');
         }
-      g_string_append_printf (buf, "\n");
+
+      if (row->is_title)
+        g_string_append_c (buf, '\n');
     }
 }
 
 static void
-append_counter_record (GString *buf, UProfReportRecord *record)
+add_counter_row (UProfCounterResult *counter,
+                 gpointer            data)
 {
-  UProfCounterResult *counter = record->data;
+  UProfReport            *report = data;
+  UProfReportPrivate     *priv = report->priv;
+  UProfReportTable       *table = &priv->table;
+  GList                  *l;
 
-  if (counter && counter->count == 0)
+  if (counter->count == 0)
     return;
 
-  append_record_entries (buf, record);
+  report_table_begin_row (table, FALSE);
 
-  /* XXX: We currently pass a NULL timer for the first record which contains
-   * the column titles... */
-  if (counter == NULL)
-    g_string_append_printf (buf, "\n");
-}
+  report_table_add_cell (table, uprof_counter_result_get_name (counter));
+  report_table_add_cell_printf (table, "%lu",
+                                uprof_counter_result_get_count (counter));
 
-static void
-append_counter_records (GString *buf, GList *records)
-{
-  GList *l;
+  for (l = priv->counter_attributes; l; l = l->next)
+    {
+      UProfAttribute *attribute = l->data;
+      UProfCountersAttributeCallback callback = attribute->callback;
+      char *value = callback (report, counter, attribute->user_data);
 
-  for (l = records; l; l = l->next)
-    append_counter_record (buf, l->data);
+      report_table_add_cell (table, value);
+      g_free (value);
+    }
 }
 
 static const char *bars[] = {
@@ -1040,100 +1215,213 @@ static const char *bars[] = {
     "█"
 };
 
-/* Note: This returns a bar 45 characters wide for 100% */
-char *
-get_percentage_bar (float percent)
+/* Note: This appends a bar 45 characters wide for 100% */
+static void
+append_percentage_bar (GString *buf, float percent)
 {
-  GString *bar = g_string_new ("");
   int bar_len = 3.6 * percent;
-  int bar_char_len = bar_len / 8;
   int i;
 
-  if (bar_len % 8)
-    bar_char_len++;
-
   for (i = bar_len; i >= 8; i -= 8)
-    g_string_append_printf (bar, "%s", bars[8]);
+    g_string_append (buf, bars[8]);
   if (i)
-    g_string_append_printf (bar, "%s", bars[i]);
+    g_string_append (buf, bars[i]);
+}
+
+static const float timer_percentiles[] = { 50, 90, 99, 99.9 };
+
+static unsigned long
+update_descendants_count_recursive (UProfTimerResult *timer)
+{
+  GList *l;
+
+  timer->descendants_count = 0;
+  for (l = timer->children; l; l = l->next)
+    {
+      UProfTimerResult *child = l->data;
+      timer->descendants_count +=
+        child->count + update_descendants_count_recursive (child);
+    }
+
+  return timer->descendants_count;
+}
+
+/* Counts the descendants of every timer in a single pass over each
+ * tree so the totals don't need to walk the tree each time */
+static void
+update_descendants_count_cb (UProfTimerResult *timer, void *data)
+{
+  if (timer->parent == NULL)
+    update_descendants_count_recursive (timer);
+}
+
+/* If requested we subtract the cost of starting and stopping all the
+ * timers nested inside this one */
+static guint64
+get_report_timer_total (UProfReport *report, UProfTimerResult *timer)
+{
+  guint64 total = _uprof_timer_result_get_total (timer);
+  guint64 overhead;
+
+  if (!report->priv->compensate_overhead)
+    return total;
+
+  overhead = timer->descendants_count * uprof_get_timer_overhead ();
+  return total > overhead ? total - overhead : 0;
+}
+
+
+/* Formats a duration in system counter ticks as msecs with 2 decimal
+ * places using integer math */
+static const char *
+format_ticks_as_msecs (char *buf, gsize len, guint64 ticks)
+{
+  guint64 ticks_per_centi_msec = MAX (uprof_get_system_counter_hz () / 100000,
+                                      1);
+  guint64 centi_msecs = ticks / ticks_per_centi_msec;
+
+  g_snprintf (buf, len, "%" G_GUINT64_FORMAT ".%02u",
+              centi_msecs / 100, (unsigned int)(centi_msecs % 100));
+  return buf;
+}
+
+/* Adds the built in count, mean, min, max and calls per second cells
+ * for a timer. The rate is relative to when the timer's context was
+ * created or last reset. */
+static void
+add_timer_call_cells (UProfReportTable *table,
+                      UProfTimerResult *timer)
+{
+  UProfContext *context = timer->object.context;
+  guint64 ticks_per_msec = MAX (uprof_get_system_counter_hz () / 1000, 1);
+  guint64 elapsed_msecs =
+    (uprof_get_system_counter () - context->reset_time) / ticks_per_msec;
+  guint64 count = timer->count;
+  char buf[32];
+
+  g_snprintf (buf, sizeof (buf), "%" G_GUINT64_FORMAT, count);
+  report_table_add_cell (table, buf);
+
+  if (count)
+    format_ticks_as_msecs (buf, sizeof (buf),
+                           _uprof_timer_result_get_total (timer) / count);
+  else
+    g_strlcpy (buf, "-", sizeof (buf));
+  report_table_add_cell (table, buf);
+
+  report_table_add_cell (table,
+                         format_ticks_as_msecs (buf, sizeof (buf),
+                                                timer->fastest));
+  report_table_add_cell (table,
+                         format_ticks_as_msecs (buf, sizeof (buf),
+                                                timer->slowest));
+
+  if (elapsed_msecs)
+    g_snprintf (buf, sizeof (buf), "%" G_GUINT64_FORMAT,
+                count * 1000 / elapsed_msecs);
+  else
+    g_strlcpy (buf, "-", sizeof (buf));
+  report_table_add_cell (table, buf);
+}
+
+/* The time spent in a timer that isn't accounted for by any of its
+ * children */
+static guint64
+get_report_timer_self (UProfReport *report, UProfTimerResult *timer)
+{
+  guint64 total = get_report_timer_total (report, timer);
+  guint64 children_total = 0;
+  GList *l;
 
-  return g_string_free (bar, FALSE);
+  for (l = timer->children; l; l = l->next)
+    children_total += get_report_timer_total (report, l->data);
+
+  return total > children_total ? total - children_total : 0;
 }
 
 static void
-prepare_report_records_for_timer_and_children (UProfReport *report,
-                                               UProfTimerResult *timer,
-                                               int indent_level,
-                                               GList **records)
+add_timer_and_children_rows (UProfReport *report,
+                             UProfContext *context,
+                             UProfTimerResult *timer,
+                             int indent_level)
 {
   UProfReportPrivate     *priv = report->priv;
-  UProfReportRecord      *record;
-  UProfReportEntry       *entry;
+  UProfReportTable       *table = &priv->table;
   int                     indent;
-  char                   *lines;
   UProfTimerResult       *root;
   float                   percent;
   GList                  *l;
   GList                  *children;
   guint64                 timer_total;
+  guint64                 timer_self;
   guint64                 root_total;
+  int                     i;
+
+  /* Timers that were never stopped are left out of the report but
+   * their children may still have been running. */
+  if (_uprof_timer_result_get_total (timer) == 0)
+    goto children;
 
-  record = g_slice_new0 (UProfReportRecord);
+  report_table_begin_row (table, FALSE);
 
   indent = indent_level * 2; /* 2 spaces per indent level */
-  entry = g_slice_new0 (UProfReportEntry);
-  lines = g_strdup_printf ("%*s%-*s",
-                           indent, "",
-                           priv->max_timer_name_size + 1 - indent,
-                           timer->object.name);
-  entry->lines = g_strsplit (lines, "\n", 0);
-  g_free (lines);
-  record->entries = g_list_prepend (record->entries, entry);
-
-  timer_total = _uprof_timer_result_get_total (timer);
-  entry = g_slice_new0 (UProfReportEntry);
-  lines = g_strdup_printf ("%-.2f",
-                           ((float)timer_total /
-                            uprof_get_system_counter_hz()) * 1000.0);
-  entry->lines = g_strsplit (lines, "\n", 0);
-  g_free (lines);
-  record->entries = g_list_prepend (record->entries, entry);
+  report_table_add_cell_printf (table, "%*s%-*s",
+                                indent, "",
+                                priv->max_timer_name_size + 1 - indent,
+                                timer->object.name);
+
+  timer_total = get_report_timer_total (report, timer);
+  report_table_add_cell_printf (table, "%-.2f",
+                                ((float)timer_total /
+                                 uprof_get_system_counter_hz()) * 1000.0);
+
+  /* percentages are reported relative to the root timer */
+  root = uprof_timer_result_get_root (timer);
+  root_total = get_report_timer_total (report, root);
+
+  timer_self = get_report_timer_self (report, timer);
+  report_table_add_cell_printf (table, "%-.2f",
+                                ((float)timer_self /
+                                 uprof_get_system_counter_hz()) * 1000.0);
+
+  report_table_add_cell_printf (table, "%7.3f%%",
+                                ((float)timer_self /
+                                 (float)root_total) * 100.0);
+
+  add_timer_call_cells (table, timer);
+
+  /* Timers belonging to linked contexts may not have a histogram */
+  if (context->timer_histograms)
+    for (i = 0; i < G_N_ELEMENTS (timer_percentiles); i++)
+      {
+        float msecs =
+          uprof_timer_result_get_percentile_msecs (timer,
+                                                   timer_percentiles[i]);
+        if (msecs < 0)
+          report_table_add_cell (table, "-");
+        else
+          report_table_add_cell_printf (table, "%-.2f", msecs);
+      }
 
   for (l = priv->timer_attributes; l; l = l->next)
     {
       UProfAttribute *attribute = l->data;
       UProfTimersAttributeCallback callback = attribute->callback;
-      entry = g_slice_new0 (UProfReportEntry);
-      lines = callback (report, timer, attribute->user_data);
-      entry->lines = g_strsplit (lines, "\n", 0);
-      g_free (lines);
-      record->entries = g_list_prepend (record->entries, entry);
+      char *value = callback (report, timer, attribute->user_data);
+
+      report_table_add_cell (table, value);
+      g_free (value);
     }
 
-  /* percentages are reported relative to the root timer */
-  root = uprof_timer_result_get_root (timer);
-  root_total = _uprof_timer_result_get_total (root);
   percent = ((float)timer_total / (float)root_total) * 100.0;
 
-  entry = g_slice_new0 (UProfReportEntry);
-  lines = g_strdup_printf ("%7.3f%%", percent);
-  entry->lines = g_strsplit (lines, "\n", 0);
-  g_free (lines);
-  entry->is_percentage = TRUE;
-  entry->percentage = percent;
-  record->entries = g_list_prepend (record->entries, entry);
-
-  entry = g_slice_new0 (UProfReportEntry);
-  lines = get_percentage_bar (percent);
-  entry->lines = g_strsplit (lines, "\n", 0);
-  g_free (lines);
-  record->entries = g_list_prepend (record->entries, entry);
+  report_table_add_cell_printf (table, "%7.3f%%", percent);
 
-  record->entries = g_list_reverse (record->entries);
-  record->data = timer;
-
-  *records = g_list_prepend (*records, record);
+  report_table_begin_cell (table);
+  append_percentage_bar (table->text, percent);
+  report_table_end_cell (table);
 
+children:
   children = _uprof_timer_result_get_children (timer);
   children = g_list_sort_with_data (children,
                                     UPROF_TIMER_SORT_TIME_INC,
@@ -1142,200 +1430,59 @@ prepare_report_records_for_timer_and_children (UProfReport *report,
     {
       UProfTimerState *child = l->data;
 
-      prepare_report_records_for_timer_and_children (report,
-                                                     child,
-                                                     indent_level + 1,
-                                                     records);
+      add_timer_and_children_rows (report,
+                                   context,
+                                   child,
+                                   indent_level + 1);
     }
   g_list_free (children);
 }
 
+/* Timer parents are declared using a string to name parents, so to
+ * resolve the parent/child hierarchy we first index all the timers of
+ * a context and its linked contexts by their parent's name and then
+ * we can look up the children of each timer directly. Timer names and
+ * parent names are interned so the index can be keyed by pointer. */
 static void
-size_record_entries (GList *records)
-{
-  UProfReportRecord *record;
-  int entries_per_record;
-  int *column_width;
-  GList *l;
-
-  if (!records)
-    return;
-
-  /* All records should have the same number of entries */
-  record = records->data;
-  entries_per_record = g_list_length (record->entries);
-  column_width = g_new0 (int, entries_per_record);
-
-  for (l = records; l; l = l->next)
-    {
-      GList *l2;
-      int i;
-
-      record = l->data;
-
-      for (l2 = record->entries, i = 0; l2; l2 = l2->next, i++)
-        {
-          UProfReportEntry *entry = l2->data;
-          int line;
-
-          g_assert (i < entries_per_record);
-
-          for (line = 0; entry->lines[line]; line++)
-            entry->width = MAX (entry->width, utf8_width (entry->lines[line]));
-
-          column_width[i] = MAX (column_width[i], entry->width);
-
-          entry->height = line;
-          record->height = MAX (record->height, entry->height);
-        }
-    }
-
-  for (l = records; l; l = l->next)
-    {
-      GList *l2;
-      int i;
-
-      record = l->data;
-
-      for (l2 = record->entries, i = 0; l2; l2 = l2->next, i++)
-        {
-          UProfReportEntry *entry = l2->data;
-          entry->width = column_width[i];
-        }
-    }
-
-  g_free (column_width);
-}
-
-static void
-append_timer_record (GString *buf, UProfReportRecord *record)
-{
-  UProfTimerResult  *timer = record->data;
-
-  if (timer && _uprof_timer_result_get_total (timer) == 0)
-    return;
-
-  append_record_entries (buf, record);
-
-  /* XXX: We currently pass a NULL timer for the first record which contains
-   * the column titles... */
-  if (timer == NULL)
-    g_string_append_printf (buf, "\n");
-}
-
-static void
-append_timer_records (GString *buf, GList *records)
+index_timer_by_parent_name_cb (UProfTimerResult *timer, void *data)
 {
-  GList *l;
+  GHashTable *children_index = data;
 
-  for (l = records; l; l = l->next)
-    append_timer_record (buf, l->data);
-}
+  /* Scrap any previously resolved hierarchy */
+  g_list_free (timer->children);
+  timer->children = NULL;
+  timer->parent = NULL;
 
-static void
-free_report_records (GList *records)
-{
-  GList *l;
-  for (l = records; l; l = l->next)
+  if (timer->parent_name)
     {
-      GList *l2;
-      UProfReportRecord *record = l->data;
-      for (l2 = record->entries; l2; l2 = l2->next)
-        {
-          UProfReportEntry *entry = l2->data;
-          g_strfreev (entry->lines);
-          g_slice_free (UProfReportEntry, entry);
-        }
-      g_slice_free (UProfReportRecord, l->data);
+      GList *siblings = g_hash_table_lookup (children_index,
+                                             timer->parent_name);
+      /* NB: we steal the old list since g_hash_table_insert() would
+       * otherwise free it */
+      g_hash_table_steal (children_index, timer->parent_name);
+      g_hash_table_insert (children_index,
+                           (char *)timer->parent_name,
+                           g_list_prepend (siblings, timer));
     }
-  g_list_free (records);
 }
 
 typedef struct
 {
-#ifdef DEBUG_TIMER_HEIRARACHY
-  int indent;
-#endif
-  UProfTimerState *parent;
-  GList *children;
-} FindChildrenState;
-
-static void
-find_timer_children_of_parent_cb (UProfContext *context,
-                                  gpointer user_data)
-{
-  FindChildrenState *state = user_data;
-  GList *l;
-  GList *children = NULL;
-
-  for (l = context->timers; l != NULL; l = l->next)
-    {
-      UProfTimerState *timer = l->data;
-      if (timer->parent_name &&
-          strcmp (timer->parent_name, state->parent->object.name) == 0)
-        children = g_list_prepend (children, timer);
-    }
-
-#ifdef DEBUG_TIMER_HEIRARACHY
-  for (l = children; l; l = l->next)
-    {
-      UProfTimerState *timer = l->data;
-      g_print ("%*smatch: timer=\"%s\" context=\"%s\"\n",
-               state->indent, "",
-               timer->object.name, uprof_context_get_name (context));
-    }
-  state->indent += 2;
-#endif
-
-  state->children = g_list_concat (state->children, children);
-}
-
-static GList *
-find_timer_children (UProfContext *context, UProfTimerState *parent)
-{
-  FindChildrenState state;
-
-#ifdef DEBUG_TIMER_HEIRARACHY
-  GList *l2;
-  g_print (" find_timer_children (context = %s, parent = %s):\n",
-           uprof_context_get_name (context), parent->object.name);
-
-  state.indent = 0;
-#endif
-
-  state.parent = parent;
-  state.children = NULL;
-
-  /* NB: links allow users to combine the timers and counters from one
-   * context into another, so when searching for the children of any
-   * given timer we also need to search any linked contexts... */
-  _uprof_context_for_self_and_links_recursive (context,
-                                               find_timer_children_of_parent_cb,
-                                               &state);
-
-  return state.children;
-}
+  UProfContext *context;
+  GHashTable *children_index;
+} ResolveTimerHeirachyState;
 
-/*
- * Timer parents are declared using a string to name parents; this function
- * takes the names and resolves them to actual UProfTimer structures.
- */
 static void
-resolve_timer_heirachy (UProfContext    *context,
-                        UProfTimerState *timer,
-                        UProfTimerState *parent)
+resolve_timer_heirachy_cb (UProfTimerResult *timer, void *data)
 {
+  ResolveTimerHeirachyState *state = data;
+  GList *children;
   GList *l;
 
-#ifdef DEBUG_TIMER_HEIRACHY
-  g_print ("resolve_timer_heirachy (context = %s, timer = %s, parent = %s)\n",
-           uprof_context_get_name (context),
-           ((UProfObjectState *)timer)->name,
-           parent ? ((UProfObjectState *)parent)->name : "NULL");
-#endif
-
-  timer->parent = parent;
-  timer->children = find_timer_children (context, timer);
+  children = g_hash_table_lookup (state->children_index, timer->object.name);
+  timer->children = g_list_copy (children);
+  for (l = timer->children; l; l = l->next)
+    ((UProfTimerState *)l->data)->parent = timer;
 
 #ifdef DEBUG_TIMER_HEIRACHY
   g_print ("resolved children of %s:\n", timer->object.name);
@@ -1343,19 +1490,9 @@ resolve_timer_heirachy (UProfContext    *context,
     g_print ("  name = %s\n", ((UProfObjectState *)l->data)->name);
 #endif
 
-  for (l = timer->children; l != NULL; l = l->next)
-    resolve_timer_heirachy (context, (UProfTimerState *)l->data, timer);
-}
-
-static void
-resolve_timer_heirachy_cb (UProfTimerResult *timer, void *data)
-{
-  UProfContext *context = data;
   if (timer->parent_name == NULL)
-    {
-      resolve_timer_heirachy (context, timer, NULL);
-      context->root_timers = g_list_prepend (context->root_timers, timer);
-    }
+    state->context->root_timers =
+      g_list_prepend (state->context->root_timers, timer);
 }
 
 #ifdef DEBUG_TIMER_HEIRARACHY
@@ -1396,6 +1533,7 @@ debug_print_timer_heirachy_cb (UProfTimerResult *timer, void *data)
 static void
 uprof_context_resolve_timer_heirachy (UProfContext *context)
 {
+  ResolveTimerHeirachyState state;
 #ifdef DEBUG_TIMER_HEIRARACHY
   GList *l;
 #endif
@@ -1403,15 +1541,30 @@ uprof_context_resolve_timer_heirachy (UProfContext *context)
   if (context->resolved)
     return;
 
-  if (context->root_timers)
-    g_list_free (context->root_timers);
+  g_list_free (context->root_timers);
+  context->root_timers = NULL;
 
   /* Use the parent names of timers to resolve the actual parent
-   * child hierarchy (fill in timer .children, and .parent members) */
+   * child hierarchy (fill in timer .children, and .parent members).
+   *
+   * NB: links allow users to combine the timers and counters from one
+   * context into another, so the children of any given timer may
+   * come from any linked context. */
+  state.context = context;
+  state.children_index =
+    g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                           NULL, (GDestroyNotify)g_list_free);
+
+  uprof_context_foreach_timer (context,
+                               NULL, /* no need to sort */
+                               index_timer_by_parent_name_cb,
+                               state.children_index);
   uprof_context_foreach_timer (context,
                                NULL, /* no need to sort */
                                resolve_timer_heirachy_cb,
-                               context);
+                               &state);
+
+  g_hash_table_destroy (state.children_index);
 
 #ifdef DEBUG_TIMER_HEIRARACHY
   g_print ("resolved root_timers:\n");
@@ -1433,46 +1586,115 @@ append_counter_statistics (GString *buf,
                            UProfContext *context)
 {
   UProfReportPrivate *priv = report->priv;
-  GList *records = NULL;
-  UProfReportRecord *record;
-  UProfReportEntry *entry;
+  UProfReportTable *table = &priv->table;
   GList *l;
 
   g_string_append_printf (buf, "counters:\n");
 
-  record = g_slice_new0 (UProfReportRecord);
-
-  entry = g_slice_new0 (UProfReportEntry);
-  entry->lines = g_strsplit ("Name", "\n", 0);
-  record->entries = g_list_prepend (record->entries, entry);
+  report_table_begin (table);
 
-  entry = g_slice_new0 (UProfReportEntry);
-  entry->lines = g_strsplit ("Total", "\n", 0);
-  record->entries = g_list_prepend (record->entries, entry);
+  report_table_begin_row (table, TRUE);
+  report_table_add_cell (table, "Name");
+  report_table_add_cell (table, "Total");
 
   for (l = priv->counter_attributes; l; l = l->next)
     {
       UProfAttribute *attribute = l->data;
-
-      entry = g_slice_new0 (UProfReportEntry);
-      entry->lines = g_strsplit (attribute->name, "\n", 0);
-      record->entries = g_list_prepend (record->entries, entry);
+      report_table_add_cell (table, attribute->name);
     }
 
-  record->entries = g_list_reverse (record->entries);
-  record->data = NULL;
+  uprof_context_foreach_counter (context,
+                                 UPROF_COUNTER_SORT_COUNT_INC,
+                                 add_counter_row,
+                                 report);
 
-  records = g_list_prepend (records, record);
+  report_table_append (table, buf);
+}
 
-  prepare_report_records_for_counters (report, context, &records);
+typedef struct
+{
+  UProfTimerResult *timer;
+  guint64 self;
+} UProfReportSelfTime;
 
-  records = g_list_reverse (records);
+typedef struct
+{
+  UProfReport *report;
+  GArray *self_times;
+} AddSelfTimeState;
 
-  size_record_entries (records);
+static void
+add_self_time_cb (UProfTimerResult *timer, void *data)
+{
+  AddSelfTimeState *state = data;
+  UProfReportSelfTime self_time;
+
+  self_time.timer = timer;
+  self_time.self = get_report_timer_self (state->report, timer);
+  g_array_append_val (state->self_times, self_time);
+}
 
-  append_counter_records (buf, records);
+static gint
+compare_self_times_cb (gconstpointer a, gconstpointer b)
+{
+  const UProfReportSelfTime *self_time_a = a;
+  const UProfReportSelfTime *self_time_b = b;
 
-  free_report_records (records);
+  if (self_time_a->self > self_time_b->self)
+    return -1;
+  else if (self_time_a->self < self_time_b->self)
+    return 1;
+  else
+    return 0;
+}
+
+/* A flat list of the timers with the most self time so the hot spots
+ * in a deep hierarchy stand out */
+static void
+append_top_self_timers (GString *buf,
+                        UProfReport *report,
+                        UProfContext *context)
+{
+  UProfReportPrivate *priv = report->priv;
+  AddSelfTimeState state;
+  guint n_timers;
+  guint i;
+
+  state.report = report;
+  state.self_times = g_array_new (FALSE, FALSE, sizeof (UProfReportSelfTime));
+  uprof_context_foreach_timer (context,
+                               NULL, /* we sort by self time below */
+                               add_self_time_cb,
+                               &state);
+  g_array_sort (state.self_times, compare_self_times_cb);
+
+  n_timers = MIN (priv->n_top_self_timers, state.self_times->len);
+
+  g_string_append_printf (buf, "\ntop %u timers by self time:\n", n_timers);
+  for (i = 0; i < n_timers; i++)
+    {
+      UProfReportSelfTime *self_time =
+        &g_array_index (state.self_times, UProfReportSelfTime, i);
+      UProfTimerResult *root = uprof_timer_result_get_root (self_time->timer);
+      guint64 root_total = get_report_timer_total (report, root);
+
+      g_string_append_printf (buf, "  %-*s %10.2f msecs %7.3f%%\n",
+                              priv->max_timer_name_size + 1,
+                              self_time->timer->object.name,
+                              ((float)self_time->self /
+                               uprof_get_system_counter_hz ()) * 1000.0,
+                              ((float)self_time->self /
+                               (float)root_total) * 100.0);
+    }
+
+  g_array_free (state.self_times, TRUE);
+}
+
+static void
+add_timer_overhead_cb (UProfTimerResult *timer, void *data)
+{
+  guint64 *overhead = data;
+  *overhead += timer->count * uprof_get_timer_overhead ();
 }
 
 static void
@@ -1481,203 +1703,367 @@ append_timer_statistics (GString *buf,
                          UProfContext *context)
 {
   UProfReportPrivate *priv = report->priv;
-  GList *records = NULL;
-  UProfReportRecord *record;
-  UProfReportEntry *entry;
+  UProfReportTable *table = &priv->table;
   GList *root_timers;
+  guint64 overhead;
   GList *l;
 
   g_string_append_printf (buf, "\n");
   g_string_append_printf (buf, "timers:\n");
   g_assert (context->resolved);
 
+  uprof_context_foreach_timer (context,
+                               NULL, /* no need to sort */
+                               update_descendants_count_cb,
+                               NULL);
+
   root_timers = uprof_context_get_root_timer_results (context);
   for (l = root_timers; l != NULL; l = l->next)
     {
       UProfTimerResult *timer = l->data;
       GList *l2;
 
-      records = NULL;
+      report_table_begin (table);
 
-      record = g_slice_new0 (UProfReportRecord);
+      report_table_begin_row (table, TRUE);
+      report_table_add_cell (table, "Name");
+      report_table_add_cell (table, "Total\nmsecs");
+      report_table_add_cell (table, "Self\nmsecs");
+      report_table_add_cell (table, "Self\npercent");
+      report_table_add_cell (table, "Count");
+      report_table_add_cell (table, "Mean\nmsecs");
+      report_table_add_cell (table, "Min\nmsecs");
+      report_table_add_cell (table, "Max\nmsecs");
+      report_table_add_cell (table, "Calls\nper sec");
 
-      entry = g_slice_new0 (UProfReportEntry);
-      entry->lines = g_strsplit ("Name", "\n", 0);
-      record->entries = g_list_prepend (record->entries, entry);
+      if (context->timer_histograms)
+        {
+          int i;
 
-      entry = g_slice_new0 (UProfReportEntry);
-      entry->lines = g_strsplit ("Total\nmsecs", "\n", 0);
-      record->entries = g_list_prepend (record->entries, entry);
+          for (i = 0; i < G_N_ELEMENTS (timer_percentiles); i++)
+            report_table_add_cell_printf (table, "p%g\nmsecs",
+                                          timer_percentiles[i]);
+        }
 
       for (l2 = priv->timer_attributes; l2; l2 = l2->next)
         {
           UProfAttribute *attribute = l2->data;
-
-          entry = g_slice_new0 (UProfReportEntry);
-          entry->lines = g_strsplit (attribute->name, "\n", 0);
-          record->entries = g_list_prepend (record->entries, entry);
+          report_table_add_cell (table, attribute->name);
         }
 
-      entry = g_slice_new0 (UProfReportEntry);
-      entry->lines = g_strsplit ("Percent", "\n", 0);
-      record->entries = g_list_prepend (record->entries, entry);
-
-      /* We need a dummy entry for the last percentage bar column because
-       * every record is expected to have the same number of entries. */
-      entry = g_slice_new0 (UProfReportEntry);
-      entry->lines = g_strsplit ("", "\n", 0);
-      record->entries = g_list_prepend (record->entries, entry);
+      report_table_add_cell (table, "Percent");
 
-      record->entries = g_list_reverse (record->entries);
-      record->data = NULL;
+      /* We need a dummy cell for the last percentage bar column because
+       * every row is expected to have the same number of cells. */
+      report_table_add_cell (table, "");
 
-      records = g_list_prepend (records, record);
+      add_timer_and_children_rows (report, context, timer, 0);
 
-      prepare_report_records_for_timer_and_children (report, timer,
-                                                     0, &records);
-
-      records = g_list_reverse (records);
-
-      size_record_entries (records);
-
-      append_timer_records (buf, records);
-      free_report_records (records);
+      report_table_append (table, buf);
     }
 
   g_list_free (root_timers);
+
+  if (priv->n_top_self_timers)
+    append_top_self_timers (buf, report, context);
+
+  overhead = 0;
+  uprof_context_foreach_timer (context,
+                               NULL, /* no need to sort */
+                               add_timer_overhead_cb,
+                               &overhead);
+  g_string_append_printf (buf,
+                          "estimated instrumentation overhead: %-.2f msecs"
+                          "%s\n",
+                          ((float)overhead /
+                           uprof_get_system_counter_hz ()) * 1000.0,
+                          priv->compensate_overhead ?
+                          " (excluded from nested timer totals)" : "");
 }
 
 static void
-add_statistic_record (UProfReport *report,
-                      UProfStatistic *statistic,
-                      GList **records)
+add_statistic_row (UProfReport *report,
+                   UProfStatistic *statistic)
 {
-  UProfReportRecord  *record;
-  UProfReportEntry   *entry;
-  char               *lines;
+  UProfReportTable   *table = &report->priv->table;
   GList              *l;
 
-  record = g_slice_new0 (UProfReportRecord);
+  report_table_begin_row (table, FALSE);
 
-  entry = g_slice_new0 (UProfReportEntry);
-  lines = g_strdup_printf ("%s", statistic->name);
-  entry->lines = g_strsplit (lines, "\n", 0);
-  g_free (lines);
-  record->entries = g_list_prepend (record->entries, entry);
+  report_table_add_cell (table, statistic->name);
 
   for (l = statistic->attributes; l; l = l->next)
     {
       UProfAttribute *attribute = l->data;
       UProfStatisticAttributeCallback callback = attribute->callback;
-      entry = g_slice_new0 (UProfReportEntry);
-      lines = callback (report,
-                        statistic->name,
-                        attribute->name,
-                        attribute->user_data);
-      entry->lines = g_strsplit (lines, "\n", 0);
-      g_free (lines);
-      record->entries = g_list_prepend (record->entries, entry);
-    }
+      char *value = callback (report,
+                              statistic->name,
+                              attribute->name,
+                              attribute->user_data);
 
-  record->entries = g_list_reverse (record->entries);
-  record->data = statistic;
-
-  *records = g_list_prepend (*records, record);
+      report_table_add_cell (table, value);
+      g_free (value);
+    }
 }
 
 static void
-prepare_report_records_for_statistics_group (UProfReport *report,
-                                             UProfStatisticsGroup *group,
-                                             GList **records)
+append_statistics_group (GString *buf,
+                         UProfReport *report,
+                         UProfStatisticsGroup *group)
 {
+  UProfReportTable *table = &report->priv->table;
   GList *l;
 
+  report_table_begin (table);
+
+  report_table_begin_row (table, TRUE);
+  report_table_add_cell (table, "Name");
+
+  /* All statistics in a group have the same attributes */
+  for (l = group->template_attributes; l; l = l->next)
+    {
+      UProfAttribute *attribute = l->data;
+      report_table_add_cell (table, attribute->name_formatted);
+    }
+
   for (l = group->statistics; l; l = l->next)
-    add_statistic_record (report, l->data, records);
+    add_statistic_row (report, l->data);
+
+  report_table_append (table, buf);
 }
 
 static void
-append_statistic_record (GString *buf, UProfReportRecord *record)
+append_context_statistics (GString *buf,
+                           UProfReport *report,
+                           UProfContext *context)
+{
+  GList *l;
+
+  if (!context->statistics_groups)
+    return;
+
+  g_string_append_printf (buf, "custom context statistics:\n");
+
+  for (l = context->statistics_groups; l; l = l->next)
+    {
+      UProfStatisticsGroup *group = l->data;
+
+      append_statistics_group (buf, report, group);
+    }
+
+  g_string_append_printf (buf, "\n");
+}
+
+static gint
+compare_call_graph_totals_cb (gconstpointer a, gconstpointer b)
 {
-  append_record_entries (buf, record);
+  const UProfCallGraphNode *node_a = a;
+  const UProfCallGraphNode *node_b = b;
 
-  /* XXX: We currently pass NULL data for the first record which contains
-   * the column titles... */
-  if (record->data == NULL)
-    g_string_append_printf (buf, "\n");
+  if (node_a->total > node_b->total)
+    return -1;
+  else if (node_a->total < node_b->total)
+    return 1;
+  else
+    return 0;
 }
 
+/* Like the timer rows, percentages are relative to the outermost
+ * timer of the path */
 static void
-append_statistic_records (GString *buf, GList *records)
-{
+add_call_graph_rows (UProfReport *report,
+                     UProfCallGraphNode *node,
+                     guint64 root_total,
+                     int indent_level)
+{
+  UProfReportTable *table = &report->priv->table;
+  guint64 children_total = 0;
+  guint64 self;
+  float percent;
   GList *l;
 
-  for (l = records; l; l = l->next)
-    append_statistic_record (buf, l->data);
-}
+  /* Nothing has completed along this path since the last reset */
+  if (node->count == 0)
+    return;
 
+  node->children = g_list_sort (node->children, compare_call_graph_totals_cb);
+  for (l = node->children; l; l = l->next)
+    {
+      UProfCallGraphNode *child = l->data;
+      children_total += child->total;
+    }
+  self = node->total > children_total ? node->total - children_total : 0;
+
+  if (indent_level == 0)
+    root_total = node->total;
+  percent = root_total ? ((float)node->total / (float)root_total) * 100.0 : 0;
+
+  report_table_begin_row (table, FALSE);
+  report_table_add_cell_printf (table, "%*s%s",
+                                indent_level * 2, "",
+                                node->timer->object.name);
+  report_table_add_cell_printf (table, "%lu", node->count);
+  report_table_add_cell_printf (table, "%-.2f",
+                                ((float)node->total /
+                                 uprof_get_system_counter_hz ()) * 1000.0);
+  report_table_add_cell_printf (table, "%-.2f",
+                                ((float)self /
+                                 uprof_get_system_counter_hz ()) * 1000.0);
+  report_table_add_cell_printf (table, "%7.3f%%", percent);
+
+  report_table_begin_cell (table);
+  append_percentage_bar (table->text, percent);
+  report_table_end_cell (table);
+
+  for (l = node->children; l; l = l->next)
+    add_call_graph_rows (report, l->data, root_total, indent_level + 1);
+}
+
+/* Appends the calling context tree recorded for any contexts with call
+ * graphs enabled, see uprof_context_enable_call_graph() */
 static void
-append_statistics_group (GString *buf,
-                         UProfReport *report,
-                         UProfStatisticsGroup *group)
+append_call_graph (GString *buf,
+                   UProfReport *report,
+                   UProfContext *context)
 {
-  GList *records = NULL;
-  UProfReportRecord *record;
-  UProfReportEntry *entry;
+  UProfReportTable *table = &report->priv->table;
+  UProfCallGraphNode *root = _uprof_call_graph_get_tree (context);
   GList *l;
 
-  record = g_slice_new0 (UProfReportRecord);
+  if (!root->children)
+    {
+      _uprof_call_graph_free_tree (root);
+      return;
+    }
 
-  entry = g_slice_new0 (UProfReportEntry);
-  entry->lines = g_strsplit ("Name", "\n", 0);
-  record->entries = g_list_prepend (record->entries, entry);
+  g_string_append_printf (buf, "\ncall graph:\n");
 
-  /* All statistics in a group have the same attributes */
-  for (l = group->template_attributes; l; l = l->next)
-    {
-      UProfAttribute *attribute = l->data;
+  report_table_begin (table);
+
+  report_table_begin_row (table, TRUE);
+  report_table_add_cell (table, "Name");
+  report_table_add_cell (table, "Count");
+  report_table_add_cell (table, "Total\nmsecs");
+  report_table_add_cell (table, "Self\nmsecs");
+  report_table_add_cell (table, "Percent");
+  report_table_add_cell (table, "");
+
+  root->children = g_list_sort (root->children, compare_call_graph_totals_cb);
+  for (l = root->children; l; l = l->next)
+    add_call_graph_rows (report, l->data, 0, 0);
 
-      entry = g_slice_new0 (UProfReportEntry);
-      entry->lines = g_strsplit (attribute->name_formatted, "\n", 0);
-      record->entries = g_list_prepend (record->entries, entry);
+  report_table_append (table, buf);
+
+  _uprof_call_graph_free_tree (root);
+}
+
+static void
+add_rate_row (UProfReport *report,
+              UProfSampler *sampler,
+              UProfObjectState *object,
+              double scale)
+{
+  UProfReportTable *table = &report->priv->table;
+  UProfSampleRates rates;
+  GString *trend = g_string_new (NULL);
+
+  /* Leave out anything that hasn't changed while being sampled */
+  if (!_uprof_sampler_get_rates (sampler, object, &rates, trend) ||
+      rates.peak == 0)
+    {
+      g_string_free (trend, TRUE);
+      return;
     }
 
-  record->entries = g_list_reverse (record->entries);
-  record->data = NULL;
+  report_table_begin_row (table, FALSE);
+  report_table_add_cell (table, object->name);
+  report_table_add_cell_printf (table, "%-.2f", rates.latest * scale);
+  report_table_add_cell_printf (table, "%-.2f", rates.mean * scale);
+  report_table_add_cell_printf (table, "%-.2f", rates.peak * scale);
+  report_table_add_cell (table, trend->str);
 
-  records = g_list_prepend (records, record);
+  g_string_free (trend, TRUE);
+}
 
-  prepare_report_records_for_statistics_group (report, group, &records);
+static void
+append_rates_table (GString *buf,
+                    UProfReport *report,
+                    UProfSampler *sampler,
+                    GList *objects,
+                    const char *title,
+                    double scale)
+{
+  UProfReportTable *table = &report->priv->table;
+  GList *l;
 
-  records = g_list_reverse (records);
+  report_table_begin (table);
 
-  size_record_entries (records);
+  report_table_begin_row (table, TRUE);
+  report_table_add_cell (table, "Name");
+  report_table_add_cell (table, "Latest");
+  report_table_add_cell (table, "Mean");
+  report_table_add_cell (table, "Peak");
+  report_table_add_cell (table, "Trend");
 
-  append_statistic_records (buf, records);
+  for (l = objects; l; l = l->next)
+    add_rate_row (report, sampler, l->data, scale);
 
-  free_report_records (records);
+  if (table->rows->len == 1)
+    return;
+
+  g_string_append_printf (buf, "%s\n", title);
+  report_table_append (table, buf);
 }
 
+typedef struct
+{
+  UProfReport *report;
+  GString *buf;
+} AppendRatesState;
+
 static void
-append_context_statistics (GString *buf,
-                           UProfReport *report,
-                           UProfContext *context)
+append_context_rates_cb (UProfContext *context, gpointer user_data)
 {
-  GList *l;
+  AppendRatesState *state = user_data;
+  UProfSampler *sampler = context->sampler;
 
-  if (!context->statistics_groups)
+  if (!sampler)
     return;
 
-  g_string_append_printf (buf, "custom context statistics:\n");
+  g_string_append_printf (state->buf,
+                          "\nrates for %s (last %u samples, every %u msecs):\n",
+                          uprof_context_get_name (context),
+                          _uprof_sampler_get_n_samples (sampler),
+                          _uprof_sampler_get_interval (sampler));
 
-  for (l = context->statistics_groups; l; l = l->next)
-    {
-      UProfStatisticsGroup *group = l->data;
+  _uprof_context_lock_objects ();
 
-      append_statistics_group (buf, report, group);
-    }
+  append_rates_table (state->buf, state->report, sampler,
+                      context->counters,
+                      "counters (per second):",
+                      1.0);
+  append_rates_table (state->buf, state->report, sampler,
+                      context->timers,
+                      "timers (msecs per second):",
+                      1000.0 / uprof_get_system_counter_hz ());
 
-  g_string_append_printf (buf, "\n");
+  _uprof_context_unlock_objects ();
+}
+
+/* Appends the rates of any counters and timers that are being
+ * sampled, see uprof_context_start_sampling() */
+static void
+append_rate_statistics (GString *buf,
+                        UProfReport *report,
+                        UProfContext *context)
+{
+  AppendRatesState state;
+
+  state.report = report;
+  state.buf = buf;
+  _uprof_context_for_self_and_links_recursive (context,
+                                               append_context_rates_cb,
+                                               &state);
 }
 
 static void
@@ -1694,6 +2080,10 @@ append_context_report (GString *buf,
   append_counter_statistics (buf, report, context);
 
   append_timer_statistics (buf, report, context);
+
+  append_call_graph (buf, report, context);
+
+  append_rate_statistics (buf, report, context);
 }
 
 static void
@@ -1720,8 +2110,8 @@ append_report_statistics (GString *buf, UProfReport *report)
 static char *
 generate_uprof_report (UProfReport *report)
 {
-  GString *buf = g_string_new ("");
   UProfReportPrivate *priv = report->priv;
+  GString *buf;
   GList *l;
   void *closure;
 
@@ -1734,6 +2124,13 @@ generate_uprof_report (UProfReport *report)
                             priv->init_fini_user_data))
     return NULL;
 
+  /* Reports tend to be a similar size each time so we try to avoid
+   * growing the buffer while generating the report */
+  buf = g_string_sized_new (priv->last_report_len);
+
+  g_string_append_printf (buf, "clock source: %s\n\n",
+                          uprof_get_system_counter_source ());
+
   append_report_statistics (buf, report);
 
   for (l = priv->top_contexts; l; l = l->next)
@@ -1744,6 +2141,8 @@ generate_uprof_report (UProfReport *report)
                          closure,
                          priv->init_fini_user_data);
 
+  priv->last_report_len = buf->len + 1;
+
   return g_string_free (buf, FALSE);
 }
 
@@ -1756,6 +2155,360 @@ _uprof_report_get_text_report (UProfReport *report,
   return TRUE;
 }
 
+gboolean
+_uprof_report_get_rates_report (UProfReport *report,
+                                char **text_ret,
+                                GError **error)
+{
+  GString *buf = g_string_new ("");
+  GList *l;
+
+  for (l = report->priv->top_contexts; l; l = l->next)
+    append_rate_statistics (buf, report, l->data);
+
+  *text_ret = g_string_free (buf, FALSE);
+  return TRUE;
+}
+
+typedef struct
+{
+  GArray *snapshot;
+  guint32 n_records;
+
+  /* For delta snapshots; the values from the client's previous
+   * snapshot and a table to record the values we send now. */
+  GHashTable *baseline;
+  GHashTable *new_baseline;
+} SnapshotState;
+
+/* Records the current values of an object for the next snapshot
+ * taken with the same cursor and returns the values recorded by the
+ * previous one, or NULL if there aren't any. *reset is set if the
+ * object's context has been reset since then, in which case the
+ * previous values no longer apply. */
+static UProfSnapshotBaselineValue *
+get_previous_values (SnapshotState *state,
+                     UProfObjectState *object,
+                     guint64 count,
+                     guint64 total,
+                     gboolean *reset)
+{
+  UProfSnapshotBaselineValue *value;
+  guint reset_generation = object->context->reset_generation;
+
+  *reset = FALSE;
+
+  if (!state->new_baseline)
+    return NULL;
+
+  if (!g_hash_table_lookup (state->new_baseline, object))
+    {
+      value = g_slice_new (UProfSnapshotBaselineValue);
+      value->count = count;
+      value->total = total;
+      value->reset_generation = reset_generation;
+      g_hash_table_insert (state->new_baseline, object, value);
+    }
+
+  value = state->baseline ?
+    g_hash_table_lookup (state->baseline, object) : NULL;
+  if (value && value->reset_generation != reset_generation)
+    {
+      *reset = TRUE;
+      return NULL;
+    }
+
+  return value;
+}
+
+/* Snapshots always include the rates so they have a fixed layout but
+ * they are only meaningful if the object's context is being sampled */
+static void
+append_snapshot_rates (GArray *snapshot, UProfObjectState *object)
+{
+  UProfSampler *sampler = object->context->sampler;
+  UProfSampleRates rates;
+  gboolean sampled =
+    sampler && _uprof_sampler_get_rates (sampler, object, &rates, NULL);
+
+  if (!sampled)
+    rates.latest = rates.mean = rates.peak = 0;
+
+  _uprof_snapshot_append_uint32 (snapshot, sampled);
+  _uprof_snapshot_append_double (snapshot, rates.latest);
+  _uprof_snapshot_append_double (snapshot, rates.mean);
+  _uprof_snapshot_append_double (snapshot, rates.peak);
+}
+
+static void
+append_snapshot_counter_cb (UProfCounterResult *counter, void *data)
+{
+  SnapshotState *state = data;
+  guint64 count = counter->count;
+  UProfSnapshotBaselineValue *baseline;
+  gint64 delta = count;
+  gboolean reset;
+
+  /* Counters can legitimately go down so we send a signed delta. If
+   * the context was reset we can only send the count since then. */
+  baseline = get_previous_values (state, (UProfObjectState *)counter,
+                                  count, 0, &reset);
+  if (baseline)
+    delta = (gint64)(count - baseline->count);
+
+  _uprof_snapshot_append_string (state->snapshot, counter->object.name);
+  _uprof_snapshot_append_uint64 (state->snapshot, count);
+  _uprof_snapshot_append_uint64 (state->snapshot, (guint64)delta);
+  _uprof_snapshot_append_uint32 (state->snapshot, reset);
+  append_snapshot_rates (state->snapshot, (UProfObjectState *)counter);
+  state->n_records++;
+}
+
+static void
+append_snapshot_timer_cb (UProfTimerResult *timer, void *data)
+{
+  SnapshotState *state = data;
+  guint64 count = timer->count;
+  guint64 total = _uprof_timer_result_get_total (timer);
+  UProfSnapshotBaselineValue *baseline;
+  gboolean reset;
+
+  /* If the context was reset we can only report what has happened
+   * since the reset */
+  baseline = get_previous_values (state, (UProfObjectState *)timer,
+                                  count, total, &reset);
+  if (baseline)
+    {
+      count -= baseline->count;
+      total -= baseline->total;
+    }
+
+  _uprof_snapshot_append_string (state->snapshot, timer->object.name);
+  _uprof_snapshot_append_string (state->snapshot, timer->parent_name);
+  _uprof_snapshot_append_uint64 (state->snapshot, count);
+  _uprof_snapshot_append_uint64 (state->snapshot, total);
+  _uprof_snapshot_append_uint64 (state->snapshot, timer->fastest);
+  _uprof_snapshot_append_uint64 (state->snapshot, timer->slowest);
+  _uprof_snapshot_append_uint32 (state->snapshot, reset);
+  append_snapshot_rates (state->snapshot, (UProfObjectState *)timer);
+  state->n_records++;
+}
+
+static void
+append_snapshot_context (UProfReport *report,
+                         UProfContext *context,
+                         SnapshotState *state)
+{
+  GArray *snapshot = state->snapshot;
+  gsize n_records_offset;
+
+  _uprof_snapshot_append_string (snapshot, uprof_context_get_name (context));
+
+  n_records_offset = snapshot->len;
+  _uprof_snapshot_append_uint32 (snapshot, 0);
+  state->n_records = 0;
+  uprof_context_foreach_counter (context,
+                                 NULL, /* no need to sort */
+                                 append_snapshot_counter_cb,
+                                 state);
+  _uprof_snapshot_set_uint32 (snapshot, n_records_offset, state->n_records);
+
+  n_records_offset = snapshot->len;
+  _uprof_snapshot_append_uint32 (snapshot, 0);
+  state->n_records = 0;
+  uprof_context_foreach_timer (context,
+                               NULL, /* no need to sort */
+                               append_snapshot_timer_cb,
+                               state);
+  _uprof_snapshot_set_uint32 (snapshot, n_records_offset, state->n_records);
+}
+
+static void
+append_snapshot_statistics (UProfReport *report, GArray *snapshot)
+{
+  UProfReportPrivate *priv = report->priv;
+  gsize n_statistics_offset;
+  guint32 n_statistics = 0;
+  GList *l;
+
+  n_statistics_offset = snapshot->len;
+  _uprof_snapshot_append_uint32 (snapshot, 0);
+
+  for (l = priv->statistics_groups; l; l = l->next)
+    {
+      UProfStatisticsGroup *group = l->data;
+      GList *l2;
+
+      for (l2 = group->statistics; l2; l2 = l2->next)
+        {
+          UProfStatistic *statistic = l2->data;
+          GList *l3;
+
+          _uprof_snapshot_append_string (snapshot, statistic->name);
+          _uprof_snapshot_append_uint32 (snapshot,
+                                         g_list_length (statistic->attributes));
+
+          for (l3 = statistic->attributes; l3; l3 = l3->next)
+            {
+              UProfAttribute *attribute = l3->data;
+              UProfStatisticAttributeCallback callback = attribute->callback;
+              char *value = callback (report,
+                                      statistic->name,
+                                      attribute->name,
+                                      attribute->user_data);
+
+              _uprof_snapshot_append_string (snapshot, attribute->name);
+              _uprof_snapshot_append_string (snapshot, value);
+              g_free (value);
+            }
+
+          n_statistics++;
+        }
+    }
+
+  _uprof_snapshot_set_uint32 (snapshot, n_statistics_offset, n_statistics);
+}
+
+/* This gives the same information as a text report but as a compact
+ * binary structure that can be cheaply and losslessly consumed by
+ * other programs. See uprof-snapshot-private.h for the layout.
+ *
+ * If a baseline is given then counts and totals are given relative
+ * to that and the current values are recorded in new_baseline. */
+static GArray *
+generate_uprof_snapshot (UProfReport *report,
+                         GHashTable *baseline,
+                         GHashTable *new_baseline)
+{
+  UProfReportPrivate *priv = report->priv;
+  SnapshotState state;
+  GArray *snapshot;
+  GList *l;
+  void *closure;
+
+  if (priv->init_callback &&
+      !priv->init_callback (report,
+                            &closure,
+                            priv->init_fini_user_data))
+    return NULL;
+
+  snapshot = g_array_new (FALSE, FALSE, 1);
+
+  _uprof_snapshot_append_uint32 (snapshot, UPROF_SNAPSHOT_MAGIC);
+  _uprof_snapshot_append_uint32 (snapshot, UPROF_SNAPSHOT_VERSION);
+  _uprof_snapshot_append_uint64 (snapshot, uprof_get_system_counter_hz ());
+  _uprof_snapshot_append_string (snapshot, uprof_get_system_counter_source ());
+  _uprof_snapshot_append_uint32 (snapshot, baseline ? 1 : 0);
+
+  append_snapshot_statistics (report, snapshot);
+
+  state.snapshot = snapshot;
+  state.baseline = baseline;
+  state.new_baseline = new_baseline;
+
+  _uprof_snapshot_append_uint32 (snapshot, g_list_length (priv->top_contexts));
+  for (l = priv->top_contexts; l; l = l->next)
+    append_snapshot_context (report, l->data, &state);
+
+  if (priv->fini_callback)
+    priv->fini_callback (report,
+                         closure,
+                         priv->init_fini_user_data);
+
+  return snapshot;
+}
+
+gboolean
+_uprof_report_get_snapshot (UProfReport *report,
+                            GArray **snapshot_ret,
+                            GError **error)
+{
+  *snapshot_ret = generate_uprof_snapshot (report, NULL, NULL);
+  if (!*snapshot_ret)
+    *snapshot_ret = g_array_new (FALSE, FALSE, 1);
+  return TRUE;
+}
+
+/* Finds the baseline for the given cursor, or creates a new one if
+ * the cursor is unknown, and moves it to the front of the list so
+ * the least recently used baselines are at the end. */
+static UProfSnapshotBaseline *
+get_snapshot_baseline (UProfReport *report, guint32 cursor)
+{
+  UProfReportPrivate *priv = report->priv;
+  UProfSnapshotBaseline *baseline;
+  GList *l;
+
+  for (l = priv->snapshot_baselines; l; l = l->next)
+    {
+      baseline = l->data;
+      if (baseline->cursor == cursor)
+        {
+          priv->snapshot_baselines =
+            g_list_delete_link (priv->snapshot_baselines, l);
+          priv->snapshot_baselines =
+            g_list_prepend (priv->snapshot_baselines, baseline);
+          return baseline;
+        }
+    }
+
+  /* Clients don't tell us when they go away so we simply forget
+   * about whoever polled least recently if there are too many */
+  if (g_list_length (priv->snapshot_baselines) >=
+      UPROF_REPORT_MAX_SNAPSHOT_CURSORS)
+    {
+      l = g_list_last (priv->snapshot_baselines);
+      free_snapshot_baseline (l->data);
+      priv->snapshot_baselines =
+        g_list_delete_link (priv->snapshot_baselines, l);
+    }
+
+  baseline = g_slice_new (UProfSnapshotBaseline);
+  baseline->cursor = priv->next_snapshot_cursor++;
+  if (priv->next_snapshot_cursor == 0)
+    priv->next_snapshot_cursor = 1;
+  baseline->values = NULL;
+
+  priv->snapshot_baselines =
+    g_list_prepend (priv->snapshot_baselines, baseline);
+
+  return baseline;
+}
+
+gboolean
+_uprof_report_get_snapshot_since (UProfReport *report,
+                                  guint32 cursor,
+                                  guint32 *cursor_ret,
+                                  GArray **snapshot_ret,
+                                  GError **error)
+{
+  UProfSnapshotBaseline *baseline = get_snapshot_baseline (report, cursor);
+  GHashTable *new_values =
+    g_hash_table_new_full (g_direct_hash,
+                           g_direct_equal,
+                           NULL,
+                           (GDestroyNotify)free_snapshot_baseline_value);
+
+  *snapshot_ret = generate_uprof_snapshot (report,
+                                           baseline->values,
+                                           new_values);
+  if (*snapshot_ret)
+    {
+      if (baseline->values)
+        g_hash_table_destroy (baseline->values);
+      baseline->values = new_values;
+    }
+  else
+    {
+      g_hash_table_destroy (new_values);
+      *snapshot_ret = g_array_new (FALSE, FALSE, 1);
+    }
+
+  *cursor_ret = baseline->cursor;
+
+  return TRUE;
+}
+
 static void
 reset_context_cb (UProfContext *context, gpointer user_data)
 {
@@ -1779,6 +2532,20 @@ _uprof_report_reset (UProfReport *report, GError **error)
   return TRUE;
 }
 
+void
+uprof_report_set_overhead_compensation (UProfReport *report,
+                                        gboolean enabled)
+{
+  report->priv->compensate_overhead = enabled;
+}
+
+void
+uprof_report_set_top_self_timers (UProfReport *report,
+                                  guint n_timers)
+{
+  report->priv->n_top_self_timers = n_timers;
+}
+
 void
 uprof_report_print (UProfReport *report)
 {
@@ -516,6 +516,38 @@ void
 uprof_report_remove_timers_attribute (UProfReport *report,
                                       const char *attribute_name);
 
+/**
+ * uprof_report_set_overhead_compensation:
+ * @report: A UProfReport
+ * @enabled: Whether to compensate for instrumentation overhead
+ *
+ * If enabled, the total time shown for each timer excludes the
+ * estimated cost of starting and stopping all the timers nested
+ * inside it. See uprof_get_timer_overhead(). This helps when child
+ * timers are used in tight loops, where their own overhead can
+ * noticeably inflate the totals of their parents.
+ *
+ * Since: 0.4
+ */
+void
+uprof_report_set_overhead_compensation (UProfReport *report,
+                                        gboolean enabled);
+
+/**
+ * uprof_report_set_top_self_timers:
+ * @report: A UProfReport
+ * @n_timers: The number of timers to list or 0 to disable the list
+ *
+ * Adds a flat list of the @n_timers timers with the most self time to
+ * the timers section of each context in the report. A timer's self
+ * time is its total time less the total time of its children.
+ *
+ * Since: 0.4
+ */
+void
+uprof_report_set_top_self_timers (UProfReport *report,
+                                  guint n_timers);
+
 void
 uprof_report_print (UProfReport *report);
 
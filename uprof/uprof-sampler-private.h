@@ -0,0 +1,67 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_SAMPLER_PRIVATE_H_
+#define _UPROF_SAMPLER_PRIVATE_H_
+
+#include <uprof-object-state.h>
+
+#include <glib.h>
+
+typedef struct _UProfSampler UProfSampler;
+
+/* Rates are per second; for timers they are in system counter ticks
+ * spent per second. */
+typedef struct
+{
+  double latest;
+  double mean;
+  double peak;
+} UProfSampleRates;
+
+UProfSampler *
+_uprof_sampler_new (UProfContext *context,
+                    guint interval_msecs,
+                    guint n_samples);
+
+void
+_uprof_sampler_free (UProfSampler *sampler);
+
+/* Forgets all the samples taken so far, e.g. when the context is
+ * reset */
+void
+_uprof_sampler_clear (UProfSampler *sampler);
+
+guint
+_uprof_sampler_get_interval (UProfSampler *sampler);
+
+guint
+_uprof_sampler_get_n_samples (UProfSampler *sampler);
+
+/* Returns FALSE if fewer than two samples of the object have been
+ * taken. If trend is non-NULL a small bar chart of the most recent
+ * rates is appended to it. */
+gboolean
+_uprof_sampler_get_rates (UProfSampler *sampler,
+                          UProfObjectState *object,
+                          UProfSampleRates *rates,
+                          GString *trend);
+
+#endif /* _UPROF_SAMPLER_PRIVATE_H_ */
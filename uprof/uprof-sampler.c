@@ -0,0 +1,252 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include <uprof.h>
+#include <uprof-context-private.h>
+#include <uprof-object-state-private.h>
+#include <uprof-timer-result-private.h>
+#include <uprof-counter-result-private.h>
+#include <uprof-sampler-private.h>
+
+#include <glib.h>
+
+/* How many of the most recent rates are drawn in a trend */
+#define UPROF_SAMPLER_TREND_LENGTH 20
+
+typedef struct
+{
+  /* Counters and timers may be added after sampling started so this
+   * is the first sample we have a value for */
+  guint64 first;
+  guint64 *values;
+} UProfSampleSeries;
+
+struct _UProfSampler
+{
+  UProfContext *context;
+  guint interval_msecs;
+  guint n_samples;
+  guint timeout_id;
+
+  /* The number of samples taken; sample i is stored at index
+   * i % n_samples of the rings */
+  guint64 n_taken;
+  guint64 *timestamps;
+
+  /* Maps each UProfCounterState or UProfTimerState to a
+   * UProfSampleSeries */
+  GHashTable *series;
+};
+
+static const char *trend_bars[] = {
+    "▁",
+    "▂",
+    "▃",
+    "▄",
+    "▅",
+    "▆",
+    "▇",
+    "█"
+};
+
+static void
+free_series (UProfSampleSeries *series)
+{
+  g_free (series->values);
+  g_slice_free (UProfSampleSeries, series);
+}
+
+static void
+record_value (UProfSampler *sampler,
+              UProfObjectState *object,
+              guint64 value)
+{
+  UProfSampleSeries *series = g_hash_table_lookup (sampler->series, object);
+
+  if (!series)
+    {
+      series = g_slice_new (UProfSampleSeries);
+      series->first = sampler->n_taken;
+      series->values = g_new (guint64, sampler->n_samples);
+      g_hash_table_insert (sampler->series, object, series);
+    }
+
+  series->values[sampler->n_taken % sampler->n_samples] = value;
+}
+
+static gboolean
+take_sample_cb (gpointer data)
+{
+  UProfSampler *sampler = data;
+  UProfContext *context = sampler->context;
+  GList *l;
+
+  sampler->timestamps[sampler->n_taken % sampler->n_samples] =
+    uprof_get_system_counter ();
+
+  /* NB: the objects lock also serializes merging the thread states */
+  _uprof_context_lock_objects ();
+
+  for (l = context->counters; l; l = l->next)
+    {
+      UProfCounterState *counter = l->data;
+
+      _uprof_counter_result_merge_thread_states (counter);
+      record_value (sampler, l->data, counter->count);
+    }
+  for (l = context->timers; l; l = l->next)
+    {
+      UProfTimerState *timer = l->data;
+
+      _uprof_timer_result_merge_thread_states (timer);
+      record_value (sampler, l->data, timer->total);
+    }
+
+  _uprof_context_unlock_objects ();
+
+  sampler->n_taken++;
+
+  return TRUE;
+}
+
+UProfSampler *
+_uprof_sampler_new (UProfContext *context,
+                    guint interval_msecs,
+                    guint n_samples)
+{
+  UProfSampler *sampler;
+
+  g_return_val_if_fail (interval_msecs > 0, NULL);
+  g_return_val_if_fail (n_samples >= 2, NULL);
+
+  sampler = g_slice_new0 (UProfSampler);
+  sampler->context = context;
+  sampler->interval_msecs = interval_msecs;
+  sampler->n_samples = n_samples;
+  sampler->timestamps = g_new (guint64, n_samples);
+  sampler->series =
+    g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify)free_series);
+
+  /* Take a first sample straight away so rates are available after
+   * one interval */
+  take_sample_cb (sampler);
+  sampler->timeout_id = g_timeout_add (interval_msecs,
+                                       take_sample_cb,
+                                       sampler);
+
+  return sampler;
+}
+
+void
+_uprof_sampler_free (UProfSampler *sampler)
+{
+  g_source_remove (sampler->timeout_id);
+  g_hash_table_destroy (sampler->series);
+  g_free (sampler->timestamps);
+  g_slice_free (UProfSampler, sampler);
+}
+
+void
+_uprof_sampler_clear (UProfSampler *sampler)
+{
+  g_hash_table_remove_all (sampler->series);
+  sampler->n_taken = 0;
+}
+
+guint
+_uprof_sampler_get_interval (UProfSampler *sampler)
+{
+  return sampler->interval_msecs;
+}
+
+guint
+_uprof_sampler_get_n_samples (UProfSampler *sampler)
+{
+  return sampler->n_samples;
+}
+
+/* The rate between sample i - 1 and sample i */
+static double
+get_interval_rate (UProfSampler *sampler,
+                   UProfSampleSeries *series,
+                   guint64 i)
+{
+  guint n_samples = sampler->n_samples;
+  guint64 prev = series->values[(i - 1) % n_samples];
+  guint64 value = series->values[i % n_samples];
+  guint64 elapsed = sampler->timestamps[i % n_samples] -
+    sampler->timestamps[(i - 1) % n_samples];
+
+  if (elapsed == 0 || value < prev)
+    return 0;
+
+  return (double)(value - prev) * uprof_get_system_counter_hz () / elapsed;
+}
+
+gboolean
+_uprof_sampler_get_rates (UProfSampler *sampler,
+                          UProfObjectState *object,
+                          UProfSampleRates *rates,
+                          GString *trend)
+{
+  UProfSampleSeries *series = g_hash_table_lookup (sampler->series, object);
+  guint64 oldest;
+  guint64 latest;
+  guint64 i;
+  double total = 0;
+
+  if (!series || sampler->n_taken == 0)
+    return FALSE;
+
+  latest = sampler->n_taken - 1;
+  oldest = MAX (series->first,
+                sampler->n_taken > sampler->n_samples ?
+                sampler->n_taken - sampler->n_samples : 0);
+  if (latest <= oldest)
+    return FALSE;
+
+  rates->peak = 0;
+  for (i = oldest + 1; i <= latest; i++)
+    {
+      double rate = get_interval_rate (sampler, series, i);
+      total += rate;
+      rates->peak = MAX (rates->peak, rate);
+    }
+  rates->mean = total / (latest - oldest);
+  rates->latest = get_interval_rate (sampler, series, latest);
+
+  if (trend)
+    {
+      i = MAX (oldest + 1,
+               latest >= UPROF_SAMPLER_TREND_LENGTH ?
+               latest - UPROF_SAMPLER_TREND_LENGTH + 1 : 0);
+      for (; i <= latest; i++)
+        {
+          double rate = get_interval_rate (sampler, series, i);
+          int bar = 0;
+
+          if (rates->peak > 0)
+            bar = (rate / rates->peak) * (G_N_ELEMENTS (trend_bars) - 1);
+          g_string_append (trend, trend_bars[bar]);
+        }
+    }
+
+  return TRUE;
+}
@@ -0,0 +1,88 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_SCOPED_TIMER_H_
+#define _UPROF_SCOPED_TIMER_H_
+
+#ifdef __cplusplus
+
+#include <uprof-context.h>
+#include <uprof-timer.h>
+
+namespace UProf {
+
+/**
+ * UProf::ScopedTimer:
+ *
+ * Starts a timer when constructed and stops it when destroyed so C++
+ * code can time a scope without having to stop the timer on every
+ * path out of it. This is normally used via UPROF_SCOPED_TIMER() which
+ * also records where the timer was first used.
+ *
+ * Since: 0.4
+ */
+class ScopedTimer
+{
+public:
+  ScopedTimer (UProfContext *context,
+               UProfTimer &timer,
+               const char *filename,
+               unsigned long line,
+               const char *function)
+    : m_timer (timer)
+  {
+    if (!m_timer.state)
+      {
+        m_timer.filename = filename;
+        m_timer.line = line;
+        m_timer.function = function;
+        uprof_context_add_timer (context, &m_timer);
+      }
+    _UPROF_TIMER_DEBUG_CHECK_FOR_RECURSION (context, m_timer);
+    _UPROF_TIMER_SET_START (m_timer);
+  }
+
+  ~ScopedTimer ()
+  {
+    UPROF_TIMER_STOP (NULL, m_timer);
+  }
+
+private:
+  /* Copying would stop the timer twice */
+  ScopedTimer (const ScopedTimer &);
+  ScopedTimer &operator= (const ScopedTimer &);
+
+  UProfTimer &m_timer;
+};
+
+} /* namespace UProf */
+
+#ifndef UPROF_DISABLE
+#define UPROF_SCOPED_TIMER(CONTEXT, TIMER_SYMBOL) \
+  UProf::ScopedTimer _uprof_scoped_##TIMER_SYMBOL ((CONTEXT), \
+                                                   (TIMER_SYMBOL), \
+                                                   __FILE__, \
+                                                   __LINE__, \
+                                                   __FUNCTION__)
+#endif
+
+#endif /* __cplusplus */
+
+#endif /* _UPROF_SCOPED_TIMER_H_ */
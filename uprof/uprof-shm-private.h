@@ -0,0 +1,69 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_SHM_PRIVATE_H_
+#define _UPROF_SHM_PRIVATE_H_
+
+#include <glib.h>
+
+/* A shared memory segment starts with a UProfShmHeader followed by
+ * n_records UProfShmRecords. The segment only ever grows so readers
+ * need to remap it if n_records outgrows their mapping.
+ *
+ * Each record is protected by a sequence lock: the publisher makes
+ * seq odd before it updates a record and even again afterwards so
+ * readers retry if seq is odd or changes while they copy a record.
+ *
+ * Names longer than UPROF_SHM_NAME_SIZE - 1 bytes are truncated. */
+#define UPROF_SHM_MAGIC 0x4d535055 /* "UPSM" */
+#define UPROF_SHM_VERSION 1
+
+#define UPROF_SHM_NAME_SIZE 64
+
+typedef enum
+{
+  UPROF_SHM_RECORD_COUNTER,
+  UPROF_SHM_RECORD_TIMER
+} UProfShmRecordType;
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  guint64 counter_hz;
+  char    context_name[UPROF_SHM_NAME_SIZE];
+  char    clock_source[UPROF_SHM_NAME_SIZE];
+  volatile guint32 n_records;
+  guint32 padding;
+} UProfShmHeader;
+
+typedef struct
+{
+  volatile guint32 seq;
+  guint32 type;
+  char    name[UPROF_SHM_NAME_SIZE];
+  char    parent_name[UPROF_SHM_NAME_SIZE];
+  guint64 count;
+  guint64 total;
+  guint64 fastest;
+  guint64 slowest;
+} UProfShmRecord;
+
+#endif /* _UPROF_SHM_PRIVATE_H_ */
@@ -0,0 +1,564 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include <uprof.h>
+#include <uprof-context-private.h>
+#include <uprof-object-state-private.h>
+#include <uprof-timer-result-private.h>
+#include <uprof-counter-result-private.h>
+#include <uprof-shm.h>
+#include <uprof-shm-private.h>
+
+#include <glib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* How many records to make room for each time the segment grows */
+#define UPROF_SHM_RECORDS_CHUNK 64
+
+/* How many times a reader tries to get a consistent copy of a record
+ * before giving up on it, in case the publisher died part way through
+ * updating it */
+#define UPROF_SHM_READ_ATTEMPTS 1000
+
+struct _UProfShmExport
+{
+  UProfContext *context;
+  char *name;
+  int fd;
+
+  UProfShmHeader *header;
+  gsize size;
+  guint32 capacity;
+
+  /* Maps each UProfCounterState or UProfTimerState to the index of
+   * its record + 1 */
+  GHashTable *records;
+  guint32 n_records;
+
+  /* Serializes uprof_shm_export_publish() */
+  GMutex *mutex;
+
+  GThread *publisher;
+  GCond *publisher_cond;
+  gboolean publisher_quit;
+  guint interval_msecs;
+};
+
+struct _UProfShmReader
+{
+  int fd;
+  const UProfShmHeader *header;
+  gsize size;
+};
+
+GQuark
+uprof_shm_error_quark (void)
+{
+  return g_quark_from_static_string ("uprof-shm-error-quark");
+}
+
+static gsize
+get_segment_size (guint32 n_records)
+{
+  return sizeof (UProfShmHeader) + n_records * sizeof (UProfShmRecord);
+}
+
+static UProfShmRecord *
+get_record (const UProfShmHeader *header, guint32 index)
+{
+  return ((UProfShmRecord *)(header + 1)) + index;
+}
+
+static void
+copy_name (char *dest, const char *name)
+{
+  if (name)
+    g_strlcpy (dest, name, UPROF_SHM_NAME_SIZE);
+  else
+    dest[0] = '\0';
+}
+
+/* We never shrink the segment so any mapping a reader has remains
+ * valid, they just need to remap to see new records. */
+static gboolean
+resize_segment (UProfShmExport *shm_export,
+                guint32 capacity,
+                GError **error)
+{
+  gsize size = get_segment_size (capacity);
+  void *header;
+
+  if (ftruncate (shm_export->fd, size) != 0)
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_FAILED,
+                   "Failed to resize shared memory segment %s: %s",
+                   shm_export->name, g_strerror (errno));
+      return FALSE;
+    }
+
+  header = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 shm_export->fd, 0);
+  if (header == MAP_FAILED)
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_FAILED,
+                   "Failed to map shared memory segment %s: %s",
+                   shm_export->name, g_strerror (errno));
+      return FALSE;
+    }
+
+  if (shm_export->header)
+    munmap (shm_export->header, shm_export->size);
+
+  shm_export->header = header;
+  shm_export->size = size;
+  shm_export->capacity = capacity;
+
+  return TRUE;
+}
+
+UProfShmExport *
+uprof_shm_export_new (UProfContext *context,
+                      const char *name,
+                      GError **error)
+{
+  UProfShmExport *shm_export;
+  UProfShmHeader *header;
+
+  g_return_val_if_fail (context != NULL, NULL);
+  g_return_val_if_fail (name != NULL, NULL);
+
+  shm_export = g_slice_new0 (UProfShmExport);
+  shm_export->name = g_strdup (name);
+
+  /* Readers may still have a stale segment of the same name mapped,
+   * e.g. left behind by a process that crashed, and truncating that
+   * would make their accesses fault. Unlinking it instead leaves their
+   * mapping intact and the fresh segment we create can't be
+   * truncated from under them because we never shrink it. */
+  shm_unlink (name);
+  shm_export->fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (shm_export->fd < 0)
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_FAILED,
+                   "Failed to create shared memory segment %s: %s",
+                   name, g_strerror (errno));
+      g_free (shm_export->name);
+      g_slice_free (UProfShmExport, shm_export);
+      return NULL;
+    }
+
+  if (!resize_segment (shm_export, UPROF_SHM_RECORDS_CHUNK, error))
+    {
+      close (shm_export->fd);
+      shm_unlink (name);
+      g_free (shm_export->name);
+      g_slice_free (UProfShmExport, shm_export);
+      return NULL;
+    }
+
+  header = shm_export->header;
+  header->version = UPROF_SHM_VERSION;
+  header->counter_hz = uprof_get_system_counter_hz ();
+  copy_name (header->context_name, uprof_context_get_name (context));
+  copy_name (header->clock_source, uprof_get_system_counter_source ());
+  header->n_records = 0;
+
+  /* Readers check the magic last */
+  __sync_synchronize ();
+  header->magic = UPROF_SHM_MAGIC;
+
+  shm_export->context = uprof_context_ref (context);
+  shm_export->records = g_hash_table_new (NULL, NULL);
+  shm_export->mutex = g_mutex_new ();
+
+  return shm_export;
+}
+
+static UProfShmRecord *
+get_export_record (UProfShmExport *shm_export,
+                   UProfObjectState *object,
+                   UProfShmRecordType type,
+                   const char *parent_name)
+{
+  guint32 index = GPOINTER_TO_UINT (g_hash_table_lookup (shm_export->records,
+                                                         object));
+  UProfShmRecord *record;
+
+  if (index)
+    return get_record (shm_export->header, index - 1);
+
+  if (shm_export->n_records == shm_export->capacity &&
+      !resize_segment (shm_export,
+                       shm_export->capacity + UPROF_SHM_RECORDS_CHUNK,
+                       NULL))
+    return NULL;
+
+  index = shm_export->n_records++;
+  g_hash_table_insert (shm_export->records,
+                       object, GUINT_TO_POINTER (index + 1));
+
+  /* The record is beyond n_records so nothing is reading it yet */
+  record = get_record (shm_export->header, index);
+  record->seq = 0;
+  record->type = type;
+  copy_name (record->name, object->name);
+  copy_name (record->parent_name, parent_name);
+
+  __sync_synchronize ();
+  shm_export->header->n_records = shm_export->n_records;
+
+  return record;
+}
+
+static void
+write_record (UProfShmRecord *record,
+              guint64 count,
+              guint64 total,
+              guint64 fastest,
+              guint64 slowest)
+{
+  record->seq++;
+  __sync_synchronize ();
+
+  record->count = count;
+  record->total = total;
+  record->fastest = fastest;
+  record->slowest = slowest;
+
+  __sync_synchronize ();
+  record->seq++;
+}
+
+/* NB: these are called with the objects lock held which serializes
+ * merging the thread states with reports, resets and exiting threads
+ * doing the same */
+static void
+publish_counter (UProfShmExport *shm_export, UProfCounterState *counter)
+{
+  UProfShmRecord *record =
+    get_export_record (shm_export, UPROF_OBJECT_STATE (counter),
+                       UPROF_SHM_RECORD_COUNTER, NULL);
+
+  if (!record)
+    return;
+
+  _uprof_counter_result_merge_thread_states (counter);
+
+  write_record (record, counter->count, 0, 0, 0);
+}
+
+static void
+publish_timer (UProfShmExport *shm_export, UProfTimerState *timer)
+{
+  UProfShmRecord *record =
+    get_export_record (shm_export, UPROF_OBJECT_STATE (timer),
+                       UPROF_SHM_RECORD_TIMER, timer->parent_name);
+
+  if (!record)
+    return;
+
+  _uprof_timer_result_merge_thread_states (timer);
+
+  write_record (record, timer->count, timer->total,
+                timer->fastest, timer->slowest);
+}
+
+void
+uprof_shm_export_publish (UProfShmExport *shm_export)
+{
+  UProfContext *context = shm_export->context;
+  GList *l;
+
+  g_mutex_lock (shm_export->mutex);
+
+  /* The calibrated frequency may be refined shortly after startup */
+  shm_export->header->counter_hz = uprof_get_system_counter_hz ();
+
+  _uprof_context_lock_objects ();
+
+  for (l = context->counters; l; l = l->next)
+    publish_counter (shm_export, l->data);
+  for (l = context->timers; l; l = l->next)
+    publish_timer (shm_export, l->data);
+
+  _uprof_context_unlock_objects ();
+
+  g_mutex_unlock (shm_export->mutex);
+}
+
+static gpointer
+publisher_thread_cb (gpointer data)
+{
+  UProfShmExport *shm_export = data;
+
+  g_mutex_lock (shm_export->mutex);
+  while (!shm_export->publisher_quit)
+    {
+      GTimeVal timeout;
+
+      g_mutex_unlock (shm_export->mutex);
+      uprof_shm_export_publish (shm_export);
+      g_mutex_lock (shm_export->mutex);
+
+      g_get_current_time (&timeout);
+      g_time_val_add (&timeout, shm_export->interval_msecs * 1000);
+      while (!shm_export->publisher_quit &&
+             g_cond_timed_wait (shm_export->publisher_cond,
+                                shm_export->mutex,
+                                &timeout))
+        ;
+    }
+  g_mutex_unlock (shm_export->mutex);
+
+  return NULL;
+}
+
+gboolean
+uprof_shm_export_start_publisher (UProfShmExport *shm_export,
+                                  guint interval_msecs,
+                                  GError **error)
+{
+  g_return_val_if_fail (shm_export->publisher == NULL, FALSE);
+
+  shm_export->interval_msecs = interval_msecs;
+  shm_export->publisher_quit = FALSE;
+  shm_export->publisher_cond = g_cond_new ();
+
+  shm_export->publisher = g_thread_create (publisher_thread_cb,
+                                           shm_export,
+                                           TRUE, /* joinable */
+                                           error);
+  if (!shm_export->publisher)
+    {
+      g_cond_free (shm_export->publisher_cond);
+      shm_export->publisher_cond = NULL;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+void
+uprof_shm_export_free (UProfShmExport *shm_export)
+{
+  if (shm_export->publisher)
+    {
+      g_mutex_lock (shm_export->mutex);
+      shm_export->publisher_quit = TRUE;
+      g_cond_signal (shm_export->publisher_cond);
+      g_mutex_unlock (shm_export->mutex);
+
+      g_thread_join (shm_export->publisher);
+      g_cond_free (shm_export->publisher_cond);
+    }
+
+  munmap (shm_export->header, shm_export->size);
+  close (shm_export->fd);
+  shm_unlink (shm_export->name);
+
+  g_hash_table_destroy (shm_export->records);
+  g_mutex_free (shm_export->mutex);
+  uprof_context_unref (shm_export->context);
+  g_free (shm_export->name);
+  g_slice_free (UProfShmExport, shm_export);
+}
+
+static gboolean
+map_reader (UProfShmReader *reader, GError **error)
+{
+  struct stat st;
+  void *header;
+
+  if (fstat (reader->fd, &st) != 0)
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_FAILED,
+                   "Failed to query shared memory segment: %s",
+                   g_strerror (errno));
+      return FALSE;
+    }
+
+  if (st.st_size < sizeof (UProfShmHeader))
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_INVALID,
+                   "Shared memory segment is too small");
+      return FALSE;
+    }
+
+  header = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+  if (header == MAP_FAILED)
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_FAILED,
+                   "Failed to map shared memory segment: %s",
+                   g_strerror (errno));
+      return FALSE;
+    }
+
+  if (reader->header)
+    munmap ((void *)reader->header, reader->size);
+
+  reader->header = header;
+  reader->size = st.st_size;
+
+  return TRUE;
+}
+
+UProfShmReader *
+uprof_shm_reader_open (const char *name,
+                       GError **error)
+{
+  UProfShmReader *reader = g_slice_new0 (UProfShmReader);
+
+  reader->fd = shm_open (name, O_RDONLY, 0);
+  if (reader->fd < 0)
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_FAILED,
+                   "Failed to open shared memory segment %s: %s",
+                   name, g_strerror (errno));
+      g_slice_free (UProfShmReader, reader);
+      return NULL;
+    }
+
+  if (!map_reader (reader, error))
+    {
+      close (reader->fd);
+      g_slice_free (UProfShmReader, reader);
+      return NULL;
+    }
+
+  if (reader->header->magic != UPROF_SHM_MAGIC ||
+      reader->header->version != UPROF_SHM_VERSION)
+    {
+      g_set_error (error, UPROF_SHM_ERROR, UPROF_SHM_ERROR_INVALID,
+                   "%s isn't a compatible UProf shared memory segment",
+                   name);
+      uprof_shm_reader_close (reader);
+      return NULL;
+    }
+
+  return reader;
+}
+
+/* Copies a record under its sequence lock. Returns FALSE if no
+ * consistent copy could be made. */
+static gboolean
+read_record (const UProfShmRecord *record, UProfShmRecord *copy)
+{
+  int attempt;
+
+  for (attempt = 0; attempt < UPROF_SHM_READ_ATTEMPTS; attempt++)
+    {
+      guint32 seq = record->seq;
+
+      if (seq & 1)
+        {
+          sched_yield ();
+          continue;
+        }
+
+      __sync_synchronize ();
+      memcpy (copy, (const void *)record, sizeof (UProfShmRecord));
+      __sync_synchronize ();
+
+      if (record->seq == seq)
+        {
+          copy->name[UPROF_SHM_NAME_SIZE - 1] = '\0';
+          copy->parent_name[UPROF_SHM_NAME_SIZE - 1] = '\0';
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+UProfSnapshot *
+uprof_shm_reader_read (UProfShmReader *reader,
+                       GError **error)
+{
+  UProfSnapshot *snapshot;
+  UProfSnapshotContext *context;
+  guint32 n_records = reader->header->n_records;
+  guint32 i;
+
+  __sync_synchronize ();
+
+  if (get_segment_size (n_records) > reader->size &&
+      !map_reader (reader, error))
+    return NULL;
+
+  snapshot = g_slice_new0 (UProfSnapshot);
+  snapshot->counter_hz = reader->header->counter_hz;
+  snapshot->clock_source = g_strndup (reader->header->clock_source,
+                                      UPROF_SHM_NAME_SIZE - 1);
+
+  context = g_slice_new0 (UProfSnapshotContext);
+  context->name = g_strndup (reader->header->context_name,
+                             UPROF_SHM_NAME_SIZE - 1);
+  snapshot->contexts = g_list_prepend (NULL, context);
+
+  for (i = 0; i < n_records; i++)
+    {
+      UProfShmRecord record;
+
+      /* Just leave out any records that are stuck mid-update */
+      if (!read_record (get_record (reader->header, i), &record))
+        continue;
+
+      if (record.type == UPROF_SHM_RECORD_COUNTER)
+        {
+          UProfSnapshotCounter *counter = g_slice_new0 (UProfSnapshotCounter);
+          counter->name = g_strdup (record.name);
+          counter->count = record.count;
+          counter->delta = record.count;
+          context->counters = g_list_prepend (context->counters, counter);
+        }
+      else
+        {
+          UProfSnapshotTimer *timer = g_slice_new0 (UProfSnapshotTimer);
+          timer->name = g_strdup (record.name);
+          if (record.parent_name[0])
+            timer->parent_name = g_strdup (record.parent_name);
+          timer->count = record.count;
+          timer->total = record.total;
+          timer->fastest = record.fastest;
+          timer->slowest = record.slowest;
+          context->timers = g_list_prepend (context->timers, timer);
+        }
+    }
+
+  context->counters = g_list_reverse (context->counters);
+  context->timers = g_list_reverse (context->timers);
+
+  return snapshot;
+}
+
+void
+uprof_shm_reader_close (UProfShmReader *reader)
+{
+  munmap ((void *)reader->header, reader->size);
+  close (reader->fd);
+  g_slice_free (UProfShmReader, reader);
+}
@@ -0,0 +1,204 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_SHM_H_
+#define _UPROF_SHM_H_
+
+#include <uprof-context.h>
+#include <uprof-snapshot.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * UPROF_SHM_ERROR:
+ *
+ * #GError domain for the uprof shared memory API
+ *
+ * Since: 0.4
+ */
+#define UPROF_SHM_ERROR (uprof_shm_error_quark ())
+
+/**
+ * UProfShmError:
+ * @UPROF_SHM_ERROR_FAILED: The shared memory segment couldn't be
+ *                          created, resized or mapped
+ * @UPROF_SHM_ERROR_INVALID: The shared memory segment wasn't created
+ *                           by a compatible version of UProf
+ *
+ * Error enumeration for the uprof shared memory API.
+ *
+ * Since: 0.4
+ */
+typedef enum { /*< prefix=UPROF_SHM_ERROR >*/
+  UPROF_SHM_ERROR_FAILED,
+  UPROF_SHM_ERROR_INVALID
+} UProfShmError;
+
+GQuark
+uprof_shm_error_quark (void);
+
+/**
+ * UProfShmExport:
+ *
+ * Publishes the counters and timers of a context in a named shared
+ * memory segment.
+ *
+ * Since: 0.4
+ */
+typedef struct _UProfShmExport UProfShmExport;
+
+/**
+ * UProfShmReader:
+ *
+ * Gives read-only access to the counters and timers published by a
+ * #UProfShmExport, possibly from a different process.
+ *
+ * Since: 0.4
+ */
+typedef struct _UProfShmReader UProfShmReader;
+
+/**
+ * uprof_shm_export_new:
+ * @context: A #UProfContext
+ * @name: The name of the shared memory segment to create, which should
+ *        start with a '/', as for shm_open()
+ * @error: A #GError return location or %NULL
+ *
+ * Creates a shared memory segment that the counters and timers of
+ * @context can be published to. Unlike reports this doesn't go via
+ * D-Bus or depend on the application's mainloop so monitoring tools
+ * can keep reading values even if the mainloop is stalled.
+ *
+ * Only the context's own counters and timers are published, not
+ * those of linked contexts.
+ *
+ * Values are only copied into the segment by
+ * uprof_shm_export_publish() or by a publisher thread started with
+ * uprof_shm_export_start_publisher().
+ *
+ * Returns: A new #UProfShmExport or %NULL if @error was set
+ *
+ * Since: 0.4
+ */
+UProfShmExport *
+uprof_shm_export_new (UProfContext *context,
+                      const char *name,
+                      GError **error);
+
+/**
+ * uprof_shm_export_publish:
+ * @shm_export: A #UProfShmExport
+ *
+ * Copies the current values of all the counters and timers into the
+ * shared memory segment. This may be called from any thread.
+ *
+ * Since: 0.4
+ */
+void
+uprof_shm_export_publish (UProfShmExport *shm_export);
+
+/**
+ * uprof_shm_export_start_publisher:
+ * @shm_export: A #UProfShmExport
+ * @interval_msecs: How often to publish the current values
+ * @error: A #GError return location or %NULL
+ *
+ * Starts a thread that calls uprof_shm_export_publish() every
+ * @interval_msecs milliseconds until the export is freed. This
+ * requires g_thread_init() to have been called.
+ *
+ * Returns: %TRUE if the publisher was started, else %FALSE and
+ *          @error is set
+ *
+ * Since: 0.4
+ */
+gboolean
+uprof_shm_export_start_publisher (UProfShmExport *shm_export,
+                                  guint interval_msecs,
+                                  GError **error);
+
+/**
+ * uprof_shm_export_free:
+ * @shm_export: A #UProfShmExport
+ *
+ * Stops any publisher thread and removes the shared memory segment.
+ * Readers that still have the segment mapped can continue to read
+ * the last published values.
+ *
+ * Since: 0.4
+ */
+void
+uprof_shm_export_free (UProfShmExport *shm_export);
+
+/**
+ * uprof_shm_reader_open:
+ * @name: The name of a shared memory segment created with
+ *        uprof_shm_export_new()
+ * @error: A #GError return location or %NULL
+ *
+ * Maps a shared memory segment read-only so the values published to
+ * it can be read with uprof_shm_reader_read().
+ *
+ * Returns: A new #UProfShmReader or %NULL if @error was set
+ *
+ * Since: 0.4
+ */
+UProfShmReader *
+uprof_shm_reader_open (const char *name,
+                       GError **error);
+
+/**
+ * uprof_shm_reader_read:
+ * @reader: A #UProfShmReader
+ * @error: A #GError return location or %NULL
+ *
+ * Reads a consistent copy of each counter and timer from the shared
+ * memory segment. The result contains a single #UProfSnapshotContext
+ * and no statistics. Timer totals only include completed samples.
+ *
+ * If a record can't be read consistently after repeated attempts,
+ * for example because the publisher crashed part way through updating
+ * it, then that counter or timer is left out of the snapshot.
+ *
+ * Returns: A new #UProfSnapshot to be freed with uprof_snapshot_free()
+ *          or %NULL if @error was set
+ *
+ * Since: 0.4
+ */
+UProfSnapshot *
+uprof_shm_reader_read (UProfShmReader *reader,
+                       GError **error);
+
+/**
+ * uprof_shm_reader_close:
+ * @reader: A #UProfShmReader
+ *
+ * Unmaps the shared memory segment and frees the reader.
+ *
+ * Since: 0.4
+ */
+void
+uprof_shm_reader_close (UProfShmReader *reader);
+
+G_END_DECLS
+
+#endif /* _UPROF_SHM_H_ */
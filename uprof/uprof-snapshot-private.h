@@ -0,0 +1,74 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_SNAPSHOT_PRIVATE_H_
+#define _UPROF_SNAPSHOT_PRIVATE_H_
+
+#include "uprof-snapshot.h"
+
+#include <glib.h>
+
+/* Snapshots are sent over D-Bus as a byte array with the following
+ * little endian layout, where strings are a guint32 length followed
+ * by that many bytes of UTF-8 without a terminating NUL and doubles
+ * are sent as the guint64 of their IEEE 754 representation:
+ *
+ *   guint32 magic, guint32 version,
+ *   guint64 counter_hz, string clock_source, guint32 delta,
+ *   guint32 n_statistics
+ *     string name, guint32 n_attributes
+ *       string name, string value
+ *   guint32 n_contexts
+ *     string name,
+ *     guint32 n_counters
+ *       string name, guint64 count, guint64 delta (two's complement),
+ *       guint32 reset, rates
+ *     guint32 n_timers
+ *       string name, string parent_name (empty for root timers),
+ *       guint64 count, guint64 total, guint64 fastest, guint64 slowest,
+ *       guint32 reset, rates
+ *
+ * where rates are:
+ *
+ *   guint32 sampled, double latest, double mean, double peak
+ */
+#define UPROF_SNAPSHOT_MAGIC 0x53525055 /* "UPRS" */
+#define UPROF_SNAPSHOT_VERSION 4
+
+void
+_uprof_snapshot_append_uint32 (GArray *snapshot, guint32 value);
+
+void
+_uprof_snapshot_append_uint64 (GArray *snapshot, guint64 value);
+
+void
+_uprof_snapshot_append_double (GArray *snapshot, double value);
+
+/* Used to fill in the number of records once they have been appended */
+void
+_uprof_snapshot_set_uint32 (GArray *snapshot, gsize offset, guint32 value);
+
+void
+_uprof_snapshot_append_string (GArray *snapshot, const char *value);
+
+UProfSnapshot *
+_uprof_snapshot_parse (const guint8 *data, gsize len, GError **error);
+
+#endif /* _UPROF_SNAPSHOT_PRIVATE_H_ */
@@ -0,0 +1,391 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#include "uprof-snapshot.h"
+#include "uprof-snapshot-private.h"
+
+#include <glib.h>
+
+#include <string.h>
+
+typedef struct
+{
+  const guint8 *data;
+  gsize len;
+  gsize offset;
+} SnapshotReader;
+
+GQuark
+uprof_snapshot_error_quark (void)
+{
+  return g_quark_from_static_string ("uprof-snapshot-error-quark");
+}
+
+void
+_uprof_snapshot_append_uint32 (GArray *snapshot, guint32 value)
+{
+  value = GUINT32_TO_LE (value);
+  g_array_append_vals (snapshot, &value, sizeof (value));
+}
+
+void
+_uprof_snapshot_append_uint64 (GArray *snapshot, guint64 value)
+{
+  value = GUINT64_TO_LE (value);
+  g_array_append_vals (snapshot, &value, sizeof (value));
+}
+
+void
+_uprof_snapshot_append_double (GArray *snapshot, double value)
+{
+  guint64 bits;
+
+  memcpy (&bits, &value, sizeof (bits));
+  _uprof_snapshot_append_uint64 (snapshot, bits);
+}
+
+void
+_uprof_snapshot_set_uint32 (GArray *snapshot, gsize offset, guint32 value)
+{
+  value = GUINT32_TO_LE (value);
+  memcpy (snapshot->data + offset, &value, sizeof (value));
+}
+
+void
+_uprof_snapshot_append_string (GArray *snapshot, const char *value)
+{
+  guint32 len = value ? strlen (value) : 0;
+
+  _uprof_snapshot_append_uint32 (snapshot, len);
+  g_array_append_vals (snapshot, value, len);
+}
+
+static gboolean
+read_bytes (SnapshotReader *reader, void *dest, gsize len, GError **error)
+{
+  if (reader->len - reader->offset < len)
+    {
+      g_set_error (error,
+                   UPROF_SNAPSHOT_ERROR,
+                   UPROF_SNAPSHOT_ERROR_INVALID,
+                   "Truncated snapshot");
+      return FALSE;
+    }
+
+  memcpy (dest, reader->data + reader->offset, len);
+  reader->offset += len;
+  return TRUE;
+}
+
+static gboolean
+read_uint32 (SnapshotReader *reader, guint32 *value, GError **error)
+{
+  if (!read_bytes (reader, value, sizeof (guint32), error))
+    return FALSE;
+  *value = GUINT32_FROM_LE (*value);
+  return TRUE;
+}
+
+static gboolean
+read_uint64 (SnapshotReader *reader, guint64 *value, GError **error)
+{
+  if (!read_bytes (reader, value, sizeof (guint64), error))
+    return FALSE;
+  *value = GUINT64_FROM_LE (*value);
+  return TRUE;
+}
+
+static gboolean
+read_double (SnapshotReader *reader, double *value, GError **error)
+{
+  guint64 bits;
+
+  if (!read_uint64 (reader, &bits, error))
+    return FALSE;
+  memcpy (value, &bits, sizeof (bits));
+  return TRUE;
+}
+
+static gboolean
+read_rates (SnapshotReader *reader, UProfSnapshotRates *rates, GError **error)
+{
+  guint32 sampled;
+
+  if (!read_uint32 (reader, &sampled, error) ||
+      !read_double (reader, &rates->latest, error) ||
+      !read_double (reader, &rates->mean, error) ||
+      !read_double (reader, &rates->peak, error))
+    return FALSE;
+  rates->sampled = sampled ? TRUE : FALSE;
+  return TRUE;
+}
+
+static gboolean
+read_string (SnapshotReader *reader, char **value, GError **error)
+{
+  guint32 len;
+
+  if (!read_uint32 (reader, &len, error))
+    return FALSE;
+
+  if (reader->len - reader->offset < len)
+    {
+      g_set_error (error,
+                   UPROF_SNAPSHOT_ERROR,
+                   UPROF_SNAPSHOT_ERROR_INVALID,
+                   "Truncated snapshot");
+      return FALSE;
+    }
+
+  *value = g_malloc (len + 1);
+  read_bytes (reader, *value, len, NULL);
+  (*value)[len] = '\0';
+
+  return TRUE;
+}
+
+static void
+free_statistic (UProfSnapshotStatistic *statistic)
+{
+  GList *l;
+
+  for (l = statistic->attributes; l; l = l->next)
+    {
+      UProfSnapshotAttribute *attribute = l->data;
+      g_free (attribute->name);
+      g_free (attribute->value);
+      g_slice_free (UProfSnapshotAttribute, attribute);
+    }
+  g_list_free (statistic->attributes);
+
+  g_free (statistic->name);
+  g_slice_free (UProfSnapshotStatistic, statistic);
+}
+
+static void
+free_context (UProfSnapshotContext *context)
+{
+  GList *l;
+
+  for (l = context->counters; l; l = l->next)
+    {
+      UProfSnapshotCounter *counter = l->data;
+      g_free (counter->name);
+      g_slice_free (UProfSnapshotCounter, counter);
+    }
+  g_list_free (context->counters);
+
+  for (l = context->timers; l; l = l->next)
+    {
+      UProfSnapshotTimer *timer = l->data;
+      g_free (timer->name);
+      g_free (timer->parent_name);
+      g_slice_free (UProfSnapshotTimer, timer);
+    }
+  g_list_free (context->timers);
+
+  g_free (context->name);
+  g_slice_free (UProfSnapshotContext, context);
+}
+
+void
+uprof_snapshot_free (UProfSnapshot *snapshot)
+{
+  g_list_foreach (snapshot->statistics, (GFunc)free_statistic, NULL);
+  g_list_free (snapshot->statistics);
+
+  g_list_foreach (snapshot->contexts, (GFunc)free_context, NULL);
+  g_list_free (snapshot->contexts);
+
+  g_free (snapshot->clock_source);
+  g_slice_free (UProfSnapshot, snapshot);
+}
+
+static gboolean
+parse_statistic (SnapshotReader *reader,
+                 UProfSnapshotStatistic *statistic,
+                 GError **error)
+{
+  guint32 n_attributes;
+  guint32 i;
+
+  if (!read_string (reader, &statistic->name, error) ||
+      !read_uint32 (reader, &n_attributes, error))
+    return FALSE;
+
+  for (i = 0; i < n_attributes; i++)
+    {
+      UProfSnapshotAttribute *attribute =
+        g_slice_new0 (UProfSnapshotAttribute);
+
+      statistic->attributes = g_list_prepend (statistic->attributes,
+                                              attribute);
+
+      if (!read_string (reader, &attribute->name, error) ||
+          !read_string (reader, &attribute->value, error))
+        return FALSE;
+    }
+  statistic->attributes = g_list_reverse (statistic->attributes);
+
+  return TRUE;
+}
+
+static gboolean
+parse_context (SnapshotReader *reader,
+               UProfSnapshotContext *context,
+               GError **error)
+{
+  guint32 n_counters;
+  guint32 n_timers;
+  guint32 i;
+
+  if (!read_string (reader, &context->name, error) ||
+      !read_uint32 (reader, &n_counters, error))
+    return FALSE;
+
+  for (i = 0; i < n_counters; i++)
+    {
+      UProfSnapshotCounter *counter = g_slice_new0 (UProfSnapshotCounter);
+      guint64 count;
+      guint64 delta;
+      guint32 reset;
+
+      context->counters = g_list_prepend (context->counters, counter);
+
+      if (!read_string (reader, &counter->name, error) ||
+          !read_uint64 (reader, &count, error) ||
+          !read_uint64 (reader, &delta, error) ||
+          !read_uint32 (reader, &reset, error) ||
+          !read_rates (reader, &counter->rates, error))
+        return FALSE;
+      counter->count = count;
+      counter->delta = (gint64)delta;
+      counter->reset = reset ? TRUE : FALSE;
+    }
+  context->counters = g_list_reverse (context->counters);
+
+  if (!read_uint32 (reader, &n_timers, error))
+    return FALSE;
+
+  for (i = 0; i < n_timers; i++)
+    {
+      UProfSnapshotTimer *timer = g_slice_new0 (UProfSnapshotTimer);
+      guint64 count;
+      guint32 reset;
+
+      context->timers = g_list_prepend (context->timers, timer);
+
+      if (!read_string (reader, &timer->name, error) ||
+          !read_string (reader, &timer->parent_name, error) ||
+          !read_uint64 (reader, &count, error) ||
+          !read_uint64 (reader, &timer->total, error) ||
+          !read_uint64 (reader, &timer->fastest, error) ||
+          !read_uint64 (reader, &timer->slowest, error) ||
+          !read_uint32 (reader, &reset, error) ||
+          !read_rates (reader, &timer->rates, error))
+        return FALSE;
+      timer->count = count;
+      timer->reset = reset ? TRUE : FALSE;
+
+      if (timer->parent_name[0] == '\0')
+        {
+          g_free (timer->parent_name);
+          timer->parent_name = NULL;
+        }
+    }
+  context->timers = g_list_reverse (context->timers);
+
+  return TRUE;
+}
+
+UProfSnapshot *
+_uprof_snapshot_parse (const guint8 *data, gsize len, GError **error)
+{
+  UProfSnapshot *snapshot = g_slice_new0 (UProfSnapshot);
+  SnapshotReader reader;
+  guint32 magic;
+  guint32 version;
+  guint32 delta;
+  guint32 n_statistics;
+  guint32 n_contexts;
+  guint32 i;
+
+  reader.data = data;
+  reader.len = len;
+  reader.offset = 0;
+
+  if (!read_uint32 (&reader, &magic, error) ||
+      !read_uint32 (&reader, &version, error))
+    goto error;
+
+  if (magic != UPROF_SNAPSHOT_MAGIC)
+    {
+      g_set_error (error,
+                   UPROF_SNAPSHOT_ERROR,
+                   UPROF_SNAPSHOT_ERROR_INVALID,
+                   "Data isn't a UProf snapshot");
+      goto error;
+    }
+  if (version != UPROF_SNAPSHOT_VERSION)
+    {
+      g_set_error (error,
+                   UPROF_SNAPSHOT_ERROR,
+                   UPROF_SNAPSHOT_ERROR_UNSUPPORTED_VERSION,
+                   "Unsupported snapshot version %u", version);
+      goto error;
+    }
+
+  if (!read_uint64 (&reader, &snapshot->counter_hz, error) ||
+      !read_string (&reader, &snapshot->clock_source, error) ||
+      !read_uint32 (&reader, &delta, error) ||
+      !read_uint32 (&reader, &n_statistics, error))
+    goto error;
+  snapshot->delta = delta ? TRUE : FALSE;
+
+  for (i = 0; i < n_statistics; i++)
+    {
+      UProfSnapshotStatistic *statistic =
+        g_slice_new0 (UProfSnapshotStatistic);
+
+      snapshot->statistics = g_list_prepend (snapshot->statistics, statistic);
+      if (!parse_statistic (&reader, statistic, error))
+        goto error;
+    }
+  snapshot->statistics = g_list_reverse (snapshot->statistics);
+
+  if (!read_uint32 (&reader, &n_contexts, error))
+    goto error;
+
+  for (i = 0; i < n_contexts; i++)
+    {
+      UProfSnapshotContext *context = g_slice_new0 (UProfSnapshotContext);
+
+      snapshot->contexts = g_list_prepend (snapshot->contexts, context);
+      if (!parse_context (&reader, context, error))
+        goto error;
+    }
+  snapshot->contexts = g_list_reverse (snapshot->contexts);
+
+  return snapshot;
+
+error:
+  uprof_snapshot_free (snapshot);
+  return NULL;
+}
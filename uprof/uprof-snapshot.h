@@ -0,0 +1,223 @@
+/* This file is part of UProf.
+ *
+ * Copyright © 2008, 2009, 2010 Robert Bragg
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301  USA
+ */
+
+#ifndef _UPROF_SNAPSHOT_H_
+#define _UPROF_SNAPSHOT_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * UPROF_SNAPSHOT_ERROR:
+ *
+ * #GError domain for the uprof snapshot API
+ *
+ * Since: 0.4
+ */
+#define UPROF_SNAPSHOT_ERROR (uprof_snapshot_error_quark ())
+
+/**
+ * UProfSnapshotError:
+ * @UPROF_SNAPSHOT_ERROR_INVALID: The snapshot data was malformed
+ * @UPROF_SNAPSHOT_ERROR_UNSUPPORTED_VERSION: The snapshot was created
+ *                                            by an incompatible version
+ *                                            of UProf
+ *
+ * Error enumeration for the uprof snapshot API.
+ *
+ * Since: 0.4
+ */
+typedef enum { /*< prefix=UPROF_SNAPSHOT_ERROR >*/
+  UPROF_SNAPSHOT_ERROR_INVALID,
+  UPROF_SNAPSHOT_ERROR_UNSUPPORTED_VERSION
+} UProfSnapshotError;
+
+GQuark
+uprof_snapshot_error_quark (void);
+
+/**
+ * UProfSnapshotRates:
+ * @sampled: %TRUE if the counter or timer's context is being sampled
+ *           with uprof_context_start_sampling() and it has been
+ *           sampled at least twice. Otherwise the rates are all zero.
+ * @latest: The rate between the two most recent samples
+ * @mean: The mean rate over all the samples kept
+ * @peak: The highest rate between any two of the samples kept
+ *
+ * The rates of change of a counter or timer. Rates are per second;
+ * for counters they are in counts and for timers they are in system
+ * counter ticks, so dividing a timer's rate by the @counter_hz of
+ * the #UProfSnapshot gives the fraction of each second spent in the
+ * timer.
+ *
+ * Since: 0.4
+ */
+typedef struct
+{
+  gboolean sampled;
+  double   latest;
+  double   mean;
+  double   peak;
+} UProfSnapshotRates;
+
+/**
+ * UProfSnapshotCounter:
+ * @name: The name of the counter
+ * @count: The current count
+ * @delta: For a delta snapshot, the change in @count since the
+ *         previous snapshot. This is negative if the counter was
+ *         decremented or zeroed in the meantime. If @reset is %TRUE,
+ *         or this isn't a delta snapshot, it is the same as @count.
+ * @reset: %TRUE if the counter's context was reset since the previous
+ *         delta snapshot
+ * @rates: The sampled rates of the counter
+ *
+ * The state of a counter at the time a #UProfSnapshot was taken.
+ *
+ * Since: 0.4
+ */
+typedef struct
+{
+  char              *name;
+  gulong             count;
+  glong              delta;
+  gboolean           reset;
+  UProfSnapshotRates rates;
+} UProfSnapshotCounter;
+
+/**
+ * UProfSnapshotTimer:
+ * @name: The name of the timer
+ * @parent_name: The name of the timer's parent or %NULL for a root timer
+ * @count: The number of times the timer has been started
+ * @total: The total elapsed time in system counter ticks
+ * @fastest: The fastest sample in system counter ticks
+ * @slowest: The slowest sample in system counter ticks
+ * @reset: %TRUE if the timer was reset since the previous delta
+ *         snapshot
+ * @rates: The sampled rates of the timer
+ *
+ * The state of a timer at the time a #UProfSnapshot was taken. All
+ * durations can be converted into seconds by dividing by
+ * the @counter_hz of the #UProfSnapshot.
+ *
+ * For a delta snapshot @count and @total only cover the samples taken
+ * since the previous snapshot, or since the timer was reset if @reset
+ * is %TRUE, while @fastest and @slowest still cover every sample since
+ * the timer was last reset.
+ *
+ * Since: 0.4
+ */
+typedef struct
+{
+  char              *name;
+  char              *parent_name;
+  gulong             count;
+  guint64            total;
+  guint64            fastest;
+  guint64            slowest;
+  gboolean           reset;
+  UProfSnapshotRates rates;
+} UProfSnapshotTimer;
+
+/**
+ * UProfSnapshotContext:
+ * @name: The name of the context
+ * @counters: A list of #UProfSnapshotCounter<!-- -->s
+ * @timers: A list of #UProfSnapshotTimer<!-- -->s
+ *
+ * The counters and timers of a context, including those of any
+ * linked contexts, at the time a #UProfSnapshot was taken.
+ *
+ * Since: 0.4
+ */
+typedef struct
+{
+  char  *name;
+  GList *counters;
+  GList *timers;
+} UProfSnapshotContext;
+
+/**
+ * UProfSnapshotAttribute:
+ * @name: The name of the attribute
+ * @value: The value of the attribute formatted as a string
+ *
+ * Since: 0.4
+ */
+typedef struct
+{
+  char *name;
+  char *value;
+} UProfSnapshotAttribute;
+
+/**
+ * UProfSnapshotStatistic:
+ * @name: The name of a custom report statistic
+ * @attributes: A list of #UProfSnapshotAttribute<!-- -->s
+ *
+ * Since: 0.4
+ */
+typedef struct
+{
+  char  *name;
+  GList *attributes;
+} UProfSnapshotStatistic;
+
+/**
+ * UProfSnapshot:
+ * @counter_hz: The frequency of the system counter used to measure
+ *              timer durations
+ * @clock_source: A description of the system counter; see
+ *                uprof_get_system_counter_source()
+ * @delta: %TRUE if the counter and timer values are relative to a
+ *         previous snapshot; see uprof_report_proxy_get_snapshot_since()
+ * @statistics: A list of the #UProfSnapshotStatistic<!-- -->s of the report
+ * @contexts: A list of the #UProfSnapshotContext<!-- -->s of the report
+ *
+ * A structured snapshot of all the statistics of a report, as
+ * returned by uprof_report_proxy_get_snapshot().
+ *
+ * Since: 0.4
+ */
+typedef struct
+{
+  guint64  counter_hz;
+  char    *clock_source;
+  gboolean delta;
+  GList   *statistics;
+  GList   *contexts;
+} UProfSnapshot;
+
+/**
+ * uprof_snapshot_free:
+ * @snapshot: A #UProfSnapshot
+ *
+ * Frees a snapshot and everything it contains.
+ *
+ * Since: 0.4
+ */
+void
+uprof_snapshot_free (UProfSnapshot *snapshot);
+
+G_END_DECLS
+
+#endif /* _UPROF_SNAPSHOT_H_ */
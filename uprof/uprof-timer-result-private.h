@@ -21,6 +21,24 @@
 #ifndef _UPROF_TIMER_RESULT_PRIVATE_H_
 #define _UPROF_TIMER_RESULT_PRIVATE_H_
 
+/* Timer histograms are log-linear; durations below
+ * UPROF_TIMER_HISTOGRAM_SUB_BUCKETS each get their own bucket and
+ * above that every power of two range is divided into
+ * UPROF_TIMER_HISTOGRAM_SUB_BUCKETS buckets, which gives ~6% worst
+ * case error for any 64bit duration. */
+#define UPROF_TIMER_HISTOGRAM_SUB_BUCKET_BITS 4
+#define UPROF_TIMER_HISTOGRAM_SUB_BUCKETS \
+  (1 << UPROF_TIMER_HISTOGRAM_SUB_BUCKET_BITS)
+#define UPROF_TIMER_HISTOGRAM_N_BUCKETS \
+  ((64 - UPROF_TIMER_HISTOGRAM_SUB_BUCKET_BITS + 1) * \
+   UPROF_TIMER_HISTOGRAM_SUB_BUCKETS)
+
+int
+_uprof_timer_histogram_bucket (guint64 duration);
+
+guint64
+_uprof_timer_histogram_bucket_upper_bound (int bucket);
+
 guint64
 _uprof_timer_result_get_total (UProfTimerResult *timer_state);
 
@@ -30,5 +48,18 @@ _uprof_timer_result_get_children (UProfTimerResult *timer);
 void
 _uprof_timer_result_reset (UProfTimerResult *timer);
 
+void
+_uprof_timer_result_merge_thread_state (UProfTimerResult *timer,
+                                        UProfTimerThreadState *thread_state);
+
+void
+_uprof_timer_result_merge_thread_states (UProfTimerResult *timer);
+
+void
+_uprof_timer_result_enable_histogram (UProfTimerResult *timer);
+
+void
+_uprof_timer_result_free_histogram (UProfTimerResult *timer);
+
 #endif /* _UPROF_TIMER_RESULT_PRIVATE_H_ */
 
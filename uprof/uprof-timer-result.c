@@ -20,9 +20,12 @@
 
 #include <uprof.h>
 #include <uprof-timer-result.h>
+#include <uprof-timer-result-private.h>
 
 #include <glib.h>
 
+#include <string.h>
+
 const char *
 uprof_timer_result_get_name (UProfTimerResult *timer)
 {
@@ -42,13 +45,12 @@ _uprof_timer_result_get_total (UProfTimerResult *timer_state)
    * without modifying the timer state. */
   if (timer_state->start != 0)
     {
-      guint64 duration;
-      if (G_LIKELY (!timer_state->disabled))
-        duration = uprof_get_system_counter() -
-          timer_state->start + timer_state->partial_duration;
-      else
-        duration = timer_state->partial_duration;
-      return timer_state->total + duration;
+      guint64 now = uprof_get_system_counter ();
+      guint64 suspended =
+        _uprof_suspend_state_get_suspended_total (timer_state->object.suspend,
+                                                  now) -
+        timer_state->suspended_at_start;
+      return timer_state->total + (now - timer_state->start - suspended);
     }
   else
     return timer_state->total;
@@ -67,6 +69,45 @@ uprof_timer_result_get_start_count (UProfTimerResult *timer)
   return timer->count;
 }
 
+float
+uprof_timer_result_get_percentile_msecs (UProfTimerResult *timer,
+                                         float             percentile)
+{
+  guint64 n_samples = 0;
+  guint64 target;
+  guint64 seen = 0;
+  int i;
+
+  if (!timer->histogram)
+    return -1;
+
+  for (i = 0; i < UPROF_TIMER_HISTOGRAM_N_BUCKETS; i++)
+    n_samples += timer->histogram[i];
+  if (!n_samples)
+    return 0;
+
+  target = (guint64)((CLAMP (percentile, 0, 100) / 100.0) * n_samples + 0.5);
+  target = CLAMP (target, 1, n_samples);
+
+  for (i = 0; i < UPROF_TIMER_HISTOGRAM_N_BUCKETS; i++)
+    {
+      seen += timer->histogram[i];
+      if (seen >= target)
+        {
+          guint64 duration = _uprof_timer_histogram_bucket_upper_bound (i);
+
+          /* The bucket bound may overshoot the slowest sample we have
+           * actually seen */
+          if (timer->slowest && duration > timer->slowest)
+            duration = timer->slowest;
+
+          return ((float)duration / uprof_get_system_counter_hz ()) * 1000.0;
+        }
+    }
+
+  return 0;
+}
+
 UProfTimerResult *
 uprof_timer_result_get_parent (UProfTimerResult *timer)
 {
@@ -110,11 +151,72 @@ _uprof_timer_result_reset (UProfTimerResult *timer)
   timer->count = 0;
 
   if (timer->start)
-    timer->start = uprof_get_system_counter();
+    {
+      guint64 now = uprof_get_system_counter ();
+      timer->suspended_at_start =
+        _uprof_suspend_state_get_suspended_total (timer->object.suspend, now);
+      timer->start = now;
+    }
 
   timer->total = 0;
-  timer->partial_duration = 0;
   timer->fastest = 0;
   timer->slowest = 0;
+
+  timer->thread_epoch++;
+
+  if (timer->histogram)
+    memset (timer->histogram, 0,
+            sizeof (guint32) * UPROF_TIMER_HISTOGRAM_N_BUCKETS);
+}
+
+void
+_uprof_timer_result_enable_histogram (UProfTimerResult *timer)
+{
+  if (!timer->histogram)
+    timer->histogram = g_new0 (guint32, UPROF_TIMER_HISTOGRAM_N_BUCKETS);
+}
+
+void
+_uprof_timer_result_free_histogram (UProfTimerResult *timer)
+{
+  g_free (timer->histogram);
+  timer->histogram = NULL;
+}
+
+/* Folds any samples accumulated by threads using
+ * UPROF_THREADED_TIMER_START/STOP into the shared timer state.
+ *
+ * Each thread only ever writes to its own state so we don't need any
+ * locking here; we just track how much of each thread's running
+ * total we have already merged. */
+void
+_uprof_timer_result_merge_thread_state (UProfTimerResult *timer,
+                                        UProfTimerThreadState *thread_state)
+{
+  unsigned long count = thread_state->count;
+  guint64 total = thread_state->total;
+
+  timer->count += count - thread_state->merged_count;
+  timer->total += total - thread_state->merged_total;
+  thread_state->merged_count = count;
+  thread_state->merged_total = total;
+
+  if (thread_state->epoch != timer->thread_epoch ||
+      thread_state->fastest == 0)
+    return;
+
+  if (timer->fastest == 0 || thread_state->fastest < timer->fastest)
+    timer->fastest = thread_state->fastest;
+  if (thread_state->slowest > timer->slowest)
+    timer->slowest = thread_state->slowest;
+}
+
+void
+_uprof_timer_result_merge_thread_states (UProfTimerResult *timer)
+{
+  GSList *l;
+
+  for (l = timer->object.thread_states; l; l = l->next)
+    _uprof_timer_result_merge_thread_state (timer, l->data);
 }
 
@@ -46,6 +46,29 @@ uprof_timer_result_get_total_msecs (UProfTimerResult *timer);
 gulong
 uprof_timer_result_get_start_count (UProfTimerResult *timer);
 
+/**
+ * uprof_timer_result_get_percentile_msecs:
+ * @timer: A #UProfTimerResult
+ * @percentile: The percentile to query, between 0 and 100
+ *
+ * Queries the duration in milliseconds that the given @percentile of
+ * samples recorded for @timer completed within. For example passing
+ * 99 returns the duration of the slowest sample once the slowest 1%
+ * of samples have been discarded.
+ *
+ * This requires timer histograms to have been enabled for the
+ * timer's context using uprof_context_enable_timer_histograms(). The
+ * result is accurate to within about 6%.
+ *
+ * Returns: The percentile duration in milliseconds or -1 if no
+ *          histogram has been recorded for @timer.
+ *
+ * Since: 0.4
+ */
+float
+uprof_timer_result_get_percentile_msecs (UProfTimerResult *timer,
+                                         float             percentile);
+
 UProfTimerResult *
 uprof_timer_result_get_parent (UProfTimerResult *timer);
 
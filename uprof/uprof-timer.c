@@ -18,10 +18,142 @@
  * MA  02110-1301  USA
  */
 
+#include "uprof.h"
 #include "uprof-timer.h"
+#include "uprof-object-state-private.h"
+#include "uprof-timer-result.h"
+#include "uprof-timer-result-private.h"
 
 #include <glib.h>
 
+int
+_uprof_timer_histogram_bucket (guint64 duration)
+{
+  int msb;
+
+  /* The first buckets map 1:1 with durations... */
+  if (duration < UPROF_TIMER_HISTOGRAM_SUB_BUCKETS)
+    return duration;
+
+  /* ...and then each power of two range is split into
+   * UPROF_TIMER_HISTOGRAM_SUB_BUCKETS linear sub-buckets so the
+   * relative error stays bounded however long a sample takes. */
+  msb = 63 - __builtin_clzll (duration);
+  return ((msb - UPROF_TIMER_HISTOGRAM_SUB_BUCKET_BITS + 1) *
+          UPROF_TIMER_HISTOGRAM_SUB_BUCKETS +
+          ((duration >> (msb - UPROF_TIMER_HISTOGRAM_SUB_BUCKET_BITS)) &
+           (UPROF_TIMER_HISTOGRAM_SUB_BUCKETS - 1)));
+}
+
+guint64
+_uprof_timer_histogram_bucket_upper_bound (int bucket)
+{
+  int range;
+  int shift;
+  guint64 base;
+
+  if (bucket < UPROF_TIMER_HISTOGRAM_SUB_BUCKETS)
+    return bucket;
+
+  range = bucket / UPROF_TIMER_HISTOGRAM_SUB_BUCKETS;
+  shift = range - 1;
+  base = (guint64)(UPROF_TIMER_HISTOGRAM_SUB_BUCKETS +
+                   bucket % UPROF_TIMER_HISTOGRAM_SUB_BUCKETS) << shift;
+
+  return base + (G_GUINT64_CONSTANT (1) << shift) - 1;
+}
+
+void
+_uprof_timer_histogram_add (guint32 *histogram, guint64 duration)
+{
+  histogram[_uprof_timer_histogram_bucket (duration)]++;
+}
+
+static UProfTimerThreadState *
+get_thread_state (UProfTimerState *state)
+{
+  return _uprof_object_state_get_thread_state (UPROF_OBJECT_STATE (state),
+                                               sizeof (UProfTimerThreadState),
+                                               (UProfObjectThreadStateMergeFunc)
+                                               _uprof_timer_result_merge_thread_state);
+}
+
+void
+_uprof_timer_threaded_start (UProfTimerState *state)
+{
+  UProfTimerThreadState *thread_state = get_thread_state (state);
+
+  if (thread_state->recursion++ == 0)
+    {
+      guint64 now = _uprof_get_system_counter_inline ();
+      if (G_UNLIKELY (_uprof_event_trace_enabled))
+        _uprof_event_trace_record (state, _UPROF_TRACE_EVENT_BEGIN, now);
+      if (G_UNLIKELY (_uprof_call_graph_enabled))
+        _uprof_call_graph_push (state, now);
+      thread_state->suspended_at_start =
+        _uprof_suspend_state_get_suspended_total (state->suspend, now);
+      thread_state->start = now;
+    }
+}
+
+void
+_uprof_timer_threaded_stop (UProfTimerState *state)
+{
+  UProfTimerThreadState *thread_state = get_thread_state (state);
+  guint64 now;
+  guint64 duration;
+
+#ifdef UPROF_DEBUG
+  if (thread_state->recursion == 0)
+    {
+      g_warning ("Stopping an un-started timer! (%s)", state->object.name);
+      return;
+    }
+#endif
+
+  if (--thread_state->recursion)
+    return;
+
+  /* NB: time spent while the context was suspended is excluded */
+  now = _uprof_get_system_counter_inline ();
+  duration = now - thread_state->start -
+    (_uprof_suspend_state_get_suspended_total (state->suspend, now) -
+     thread_state->suspended_at_start);
+
+  if (G_UNLIKELY (_uprof_event_trace_enabled))
+    _uprof_event_trace_record (state, _UPROF_TRACE_EVENT_END, now);
+  if (G_UNLIKELY (_uprof_call_graph_enabled))
+    _uprof_call_graph_pop (state, now);
+
+  thread_state->count++;
+  if (G_UNLIKELY (duration == 0))
+    return;
+
+  /* If the timer has been reset since our last sample then our
+   * fastest/slowest values no longer apply */
+  if (G_UNLIKELY (thread_state->epoch != state->thread_epoch))
+    {
+      thread_state->epoch = state->thread_epoch;
+      thread_state->fastest = 0;
+      thread_state->slowest = 0;
+    }
+
+  if (thread_state->fastest == 0 || duration < thread_state->fastest)
+    thread_state->fastest = duration;
+  if (duration > thread_state->slowest)
+    thread_state->slowest = duration;
+
+  thread_state->total += duration;
+
+  /* The histogram is shared between threads so it is updated
+   * atomically. */
+  if (G_UNLIKELY (state->histogram))
+    {
+      int bucket = _uprof_timer_histogram_bucket (duration);
+      g_atomic_int_add ((gint *)&state->histogram[bucket], 1);
+    }
+}
+
 gint
 _uprof_timer_compare_total_times (UProfTimerState *a,
                                   UProfTimerState *b,
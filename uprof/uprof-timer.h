@@ -24,6 +24,7 @@
 #include <glib.h>
 
 #include <uprof-object-state.h>
+#include <uprof-clock.h>
 
 G_BEGIN_DECLS
 
@@ -34,34 +35,65 @@ struct _UProfTimerState
 
   UProfObjectState  object;
 
-  gboolean          disabled;
+  gboolean          unused;
   int               recursion;
 
-  char             *parent_name;
-
-  unsigned long     count;
-  guint64           start;
+  /* Everything UPROF_TIMER_START() and UPROF_TIMER_STOP() touch is
+   * packed into the second cache line of the state, away from the
+   * metadata that's only needed for reporting. */
+  guint64           start _UPROF_CACHE_LINE_ALIGNED;
+  /* The total time the context had been suspended when the timer
+   * was started; see UProfSuspendState */
+  guint64           suspended_at_start;
   guint64           total;
-  guint64           partial_duration;
+  unsigned long     count;
 
   guint64           fastest;
   guint64           slowest;
 
+  /* Optional log-linear histogram of sample durations, allocated if
+   * the context has been asked to track timer histograms */
+  guint32          *histogram;
+
+  /* A copy of object.suspend so the macros don't need to touch the
+   * first cache line */
+  UProfSuspendState *suspend;
+
+  /* Interned, like object.name */
+  const char       *parent_name;
+
   /* note: not resolved until sorting @ report time */
   UProfTimerState  *parent;
   GList            *children;
 
-  unsigned long padding0;
-  unsigned long padding1;
-  unsigned long padding2;
-  unsigned long padding3;
-  unsigned long padding4;
-  unsigned long padding5;
-  unsigned long padding6;
-  unsigned long padding7;
-  unsigned long padding8;
-  unsigned long padding9;
-};
+  /* The total count of all the timers nested inside this one. Only
+   * valid while a report is being generated. */
+  unsigned long     descendants_count;
+
+  /* Bumped whenever the timer is reset so that per-thread states
+   * know to discard their fastest/slowest samples. */
+  unsigned int      thread_epoch;
+} _UPROF_CACHE_LINE_ALIGNED;
+
+typedef struct _UProfTimerThreadState
+{
+  /*< private >*/
+  int               recursion;
+  unsigned int      epoch;
+
+  unsigned long     count;
+  guint64           start;
+  guint64           suspended_at_start;
+  guint64           total;
+
+  guint64           fastest;
+  guint64           slowest;
+
+  /* The portion of count and total already merged into the shared
+   * UProfTimerState. Only touched while merging at report time. */
+  unsigned long     merged_count;
+  guint64           merged_total;
+} UProfTimerThreadState;
 
 typedef struct _UProfTimer
 {
@@ -162,6 +194,62 @@ typedef struct _UProfTimer
 #define _UPROF_TIMER_DEBUG_CHECK_FOR_RECURSION(CONTEXT, TIMER_SYMBOL)
 #endif
 
+/* See uprof_context_enable_event_trace() */
+typedef enum
+{
+  _UPROF_TRACE_EVENT_BEGIN,
+  _UPROF_TRACE_EVENT_END
+} _UProfTraceEventType;
+
+/* The number of contexts with event tracing enabled */
+extern int _uprof_event_trace_enabled;
+
+void
+_uprof_event_trace_record (UProfTimerState *timer,
+                           _UProfTraceEventType type,
+                           guint64 timestamp);
+
+#define _UPROF_TIMER_TRACE_EVENT(TIMER_SYMBOL, TYPE, TIMESTAMP) \
+  do { \
+    if (G_UNLIKELY (_uprof_event_trace_enabled)) \
+      _uprof_event_trace_record ((TIMER_SYMBOL).state, TYPE, TIMESTAMP); \
+  } while (0)
+
+/* See uprof_context_enable_call_graph() */
+
+/* The number of contexts with call graphs enabled */
+extern int _uprof_call_graph_enabled;
+
+void
+_uprof_call_graph_push (UProfTimerState *timer, guint64 timestamp);
+
+void
+_uprof_call_graph_pop (UProfTimerState *timer, guint64 timestamp);
+
+#define _UPROF_TIMER_CALL_GRAPH_PUSH(TIMER_SYMBOL, TIMESTAMP) \
+  do { \
+    if (G_UNLIKELY (_uprof_call_graph_enabled)) \
+      _uprof_call_graph_push ((TIMER_SYMBOL).state, TIMESTAMP); \
+  } while (0)
+
+#define _UPROF_TIMER_CALL_GRAPH_POP(TIMER_SYMBOL, TIMESTAMP) \
+  do { \
+    if (G_UNLIKELY (_uprof_call_graph_enabled)) \
+      _uprof_call_graph_pop ((TIMER_SYMBOL).state, TIMESTAMP); \
+  } while (0)
+
+#define _UPROF_TIMER_SET_START(TIMER_SYMBOL) \
+  do { \
+    guint64 _now = _uprof_get_system_counter_inline (); \
+    _UPROF_TIMER_TRACE_EVENT (TIMER_SYMBOL, _UPROF_TRACE_EVENT_BEGIN, _now); \
+    _UPROF_TIMER_CALL_GRAPH_PUSH (TIMER_SYMBOL, _now); \
+    (TIMER_SYMBOL).state->suspended_at_start = \
+      _uprof_suspend_state_get_suspended_total ( \
+                                     (TIMER_SYMBOL).state->suspend, \
+                                     _now); \
+    (TIMER_SYMBOL).state->start = _now; \
+  } while (0)
+
 /**
  * UPROF_TIMER_START:
  * CONTEXT: A UProfContext
@@ -176,7 +264,7 @@ typedef struct _UProfTimer
     if (!(TIMER_SYMBOL).state) \
       _UPROF_TIMER_INIT_IF_UNSEEN (CONTEXT, TIMER_SYMBOL); \
     _UPROF_TIMER_DEBUG_CHECK_FOR_RECURSION (CONTEXT, TIMER_SYMBOL); \
-    (TIMER_SYMBOL).state->start = uprof_get_system_counter (); \
+    _UPROF_TIMER_SET_START (TIMER_SYMBOL); \
   } while (0)
 
 /**
@@ -195,7 +283,7 @@ typedef struct _UProfTimer
       _UPROF_TIMER_INIT_IF_UNSEEN (CONTEXT, TIMER_SYMBOL); \
     if ((TIMER_SYMBOL).state->recursion++ == 0) \
       { \
-        (TIMER_SYMBOL).state->start = uprof_get_system_counter (); \
+        _UPROF_TIMER_SET_START (TIMER_SYMBOL); \
       } \
   } while (0)
 
@@ -212,31 +300,35 @@ typedef struct _UProfTimer
 #define _UPROF_TIMER_DEBUG_CHECK_TIMER_WAS_STARTED(CONTEXT, TIMER_SYMBOL)
 #endif
 
+void
+_uprof_timer_histogram_add (guint32 *histogram, guint64 duration);
+
 #define _UPROF_TIMER_UPDATE_TOTAL_AND_CMP_FAST_SLOW(TIMER_SYMBOL) \
   do { \
-    if (G_UNLIKELY (duration < (TIMER_SYMBOL).state->fastest)) \
+    if (G_UNLIKELY (duration < (TIMER_SYMBOL).state->fastest || \
+                    (TIMER_SYMBOL).state->fastest == 0)) \
       (TIMER_SYMBOL).state->fastest = duration; \
-    else if (G_UNLIKELY (duration > (TIMER_SYMBOL).state->slowest)) \
+    if (G_UNLIKELY (duration > (TIMER_SYMBOL).state->slowest)) \
       (TIMER_SYMBOL).state->slowest = duration; \
     (TIMER_SYMBOL).state->total += duration; \
+    if (G_UNLIKELY ((TIMER_SYMBOL).state->histogram)) \
+      _uprof_timer_histogram_add ((TIMER_SYMBOL).state->histogram, duration); \
   } while (0)
 
+/* NB: any time the context was suspended while the timer was running
+ * is excluded from the duration. If the context was suspended for the
+ * whole time then the sample is ignored. */
 #define _UPROF_TIMER_UPDATE_TOTAL_FASTEST_SLOWEST(CONTEXT, TIMER_SYMBOL) \
   do { \
-    if (G_LIKELY (!(TIMER_SYMBOL).state->disabled)) \
-      { \
-        guint64 duration = uprof_get_system_counter() - \
-                           (TIMER_SYMBOL).state->start + \
-                           (TIMER_SYMBOL).state->partial_duration; \
-        (TIMER_SYMBOL).state->partial_duration = 0; \
-        _UPROF_TIMER_UPDATE_TOTAL_AND_CMP_FAST_SLOW (TIMER_SYMBOL); \
-      } \
-    else if (G_UNLIKELY ((TIMER_SYMBOL).state->partial_duration)) \
-      { \
-        guint64 duration = (TIMER_SYMBOL).state->partial_duration; \
-        (TIMER_SYMBOL).state->partial_duration = 0; \
-        _UPROF_TIMER_UPDATE_TOTAL_AND_CMP_FAST_SLOW (TIMER_SYMBOL); \
-      } \
+    UProfSuspendState *_suspend = (TIMER_SYMBOL).state->suspend; \
+    guint64 _now = _uprof_get_system_counter_inline (); \
+    guint64 duration = _now - (TIMER_SYMBOL).state->start - \
+      (_uprof_suspend_state_get_suspended_total (_suspend, _now) - \
+       (TIMER_SYMBOL).state->suspended_at_start); \
+    _UPROF_TIMER_TRACE_EVENT (TIMER_SYMBOL, _UPROF_TRACE_EVENT_END, _now); \
+    _UPROF_TIMER_CALL_GRAPH_POP (TIMER_SYMBOL, _now); \
+    if (G_LIKELY (duration)) \
+      _UPROF_TIMER_UPDATE_TOTAL_AND_CMP_FAST_SLOW (TIMER_SYMBOL); \
   } while (0)
 
 /**
@@ -276,6 +368,132 @@ typedef struct _UProfTimer
       } \
   } while (0)
 
+void
+_uprof_timer_threaded_start (UProfTimerState *state);
+
+void
+_uprof_timer_threaded_stop (UProfTimerState *state);
+
+/**
+ * UPROF_THREADED_TIMER_START:
+ * CONTEXT: A UProfContext
+ * TIMER_SYMBOL: A timer variable
+ *
+ * Starts the timer timing like UPROF_TIMER_START() but keeps the
+ * timing state private to the calling thread so that the same timer
+ * can be used concurrently by multiple threads without any locking.
+ * The per-thread results are merged together when iterating the
+ * timers of a context, such as when generating a report.
+ *
+ * Threaded timers may also be started recursively, so there is no
+ * need for a separate recursive variant; UPROF_THREADED_TIMER_STOP()
+ * must be called an equal number of times to actually stop it timing.
+ *
+ * As with other timers any time the timer's context is suspended is
+ * excluded.
+ *
+ * Since: 0.4
+ */
+#define UPROF_THREADED_TIMER_START(CONTEXT, TIMER_SYMBOL) \
+  do { \
+    if (!(TIMER_SYMBOL).state) \
+      _UPROF_TIMER_INIT_IF_UNSEEN (CONTEXT, TIMER_SYMBOL); \
+    _uprof_timer_threaded_start ((TIMER_SYMBOL).state); \
+  } while (0)
+
+/**
+ * UPROF_THREADED_TIMER_STOP:
+ * CONTEXT: A UProfContext
+ * TIMER_SYMBOL: A timer variable
+ *
+ * Stops a timer previously started in the same thread with
+ * UPROF_THREADED_TIMER_START().
+ *
+ * Since: 0.4
+ */
+#define UPROF_THREADED_TIMER_STOP(CONTEXT, TIMER_SYMBOL) \
+  do { \
+    _uprof_timer_threaded_stop ((TIMER_SYMBOL).state); \
+  } while (0)
+
+/* C++ code gets a UProf::ScopedTimer based UPROF_SCOPED_TIMER() from
+ * uprof-scoped-timer.h instead */
+#ifndef __cplusplus
+
+static inline void
+_uprof_scoped_timer_stop (UProfTimer **timer)
+{
+  UPROF_TIMER_STOP (NULL, **timer);
+}
+
+/**
+ * UPROF_SCOPED_TIMER:
+ * CONTEXT: A UProfContext
+ * TIMER_SYMBOL: A timer variable
+ *
+ * Starts the timer timing like UPROF_TIMER_START() and automatically
+ * stops it with UPROF_TIMER_STOP() when the enclosing scope is left,
+ * including via an early return, so there's no risk of leaving the
+ * timer running by accident. Stopping the timer doesn't add any
+ * branches of its own.
+ *
+ * This declares a variable so it must be used where a declaration
+ * is allowed, and only once per timer in a given scope.
+ *
+ * This relies on the cleanup attribute supported by GCC and Clang.
+ *
+ * Since: 0.4
+ */
+#define UPROF_SCOPED_TIMER(CONTEXT, TIMER_SYMBOL) \
+  UProfTimer *_uprof_scoped_##TIMER_SYMBOL \
+    __attribute__ ((cleanup (_uprof_scoped_timer_stop), unused)) = \
+    ({ UPROF_TIMER_START (CONTEXT, TIMER_SYMBOL); &(TIMER_SYMBOL); })
+
+#endif /* __cplusplus */
+
+/* If UPROF_DISABLE is defined before including uprof.h then all the
+ * timer macros compile to nothing so instrumented code pays no runtime
+ * cost. Timers can still be declared and referenced so instrumented
+ * code doesn't need any extra #ifdefs. The arguments are only
+ * referenced from dead code so they are never evaluated. */
+#ifdef UPROF_DISABLE
+
+#define _UPROF_TIMER_NOP(CONTEXT, TIMER_SYMBOL) \
+  do { \
+    if (0) \
+      { \
+        (void)(CONTEXT); \
+        (void)(TIMER_SYMBOL); \
+      } \
+  } while (0)
+
+#undef UPROF_TIMER_START
+#undef UPROF_RECURSIVE_TIMER_START
+#undef UPROF_TIMER_STOP
+#undef UPROF_RECURSIVE_TIMER_STOP
+#undef UPROF_THREADED_TIMER_START
+#undef UPROF_THREADED_TIMER_STOP
+#undef UPROF_SCOPED_TIMER
+
+#define UPROF_TIMER_START(CONTEXT, TIMER_SYMBOL) \
+  _UPROF_TIMER_NOP (CONTEXT, TIMER_SYMBOL)
+#define UPROF_RECURSIVE_TIMER_START(CONTEXT, TIMER_SYMBOL) \
+  _UPROF_TIMER_NOP (CONTEXT, TIMER_SYMBOL)
+#define UPROF_TIMER_STOP(CONTEXT, TIMER_SYMBOL) \
+  _UPROF_TIMER_NOP (CONTEXT, TIMER_SYMBOL)
+#define UPROF_RECURSIVE_TIMER_STOP(CONTEXT, TIMER_SYMBOL) \
+  _UPROF_TIMER_NOP (CONTEXT, TIMER_SYMBOL)
+#define UPROF_THREADED_TIMER_START(CONTEXT, TIMER_SYMBOL) \
+  _UPROF_TIMER_NOP (CONTEXT, TIMER_SYMBOL)
+#define UPROF_THREADED_TIMER_STOP(CONTEXT, TIMER_SYMBOL) \
+  _UPROF_TIMER_NOP (CONTEXT, TIMER_SYMBOL)
+/* Unlike the other macros this has to expand to a declaration */
+#define UPROF_SCOPED_TIMER(CONTEXT, TIMER_SYMBOL) \
+  G_GNUC_UNUSED int _uprof_scoped_##TIMER_SYMBOL = \
+    (int)sizeof ((void)(CONTEXT), &(TIMER_SYMBOL))
+
+#endif /* UPROF_DISABLE */
+
 /* XXX: We should consider system counter wrap around issues */
 
 gint
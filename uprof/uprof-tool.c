@@ -110,6 +110,7 @@ static gboolean arg_list = FALSE;
 static gboolean arg_zero = FALSE;
 static char *arg_bus_name = NULL;
 static char *arg_report_name = NULL;
+static char *arg_shm_name = NULL;
 static char **arg_remaining = NULL;
 
 static GMainLoop *mainloop;
@@ -128,6 +129,7 @@ static GList *current_option_link;
 static int queue_redraw_idle_id;
 
 static int get_report_timeout_id;
+static guint32 snapshot_cursor;
 static char *timers_counters_report;
 
 static int screen_width, screen_height;
@@ -218,6 +220,10 @@ static GOptionEntry uprof_tool_args[] = {
   { "zero", 'z', 0, G_OPTION_ARG_NONE, &arg_zero,
     "Reset the timers and counters of a report", NULL },
 
+  { "shm", 's', 0, G_OPTION_ARG_STRING, &arg_shm_name,
+    "Print the timers and counters published to a shared memory segment",
+    "NAME" },
+
   { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &arg_remaining,
     "COMMAND", NULL },
   { NULL, },
@@ -498,31 +504,148 @@ ut_warning (UTWarnLevel level, const char *format, ...)
     g_timeout_add_seconds (5, (GSourceFunc)idle_warnings_cb, NULL);
 }
 
+static void
+append_snapshot_timer (GString *report,
+                       UProfSnapshotTimer *timer,
+                       GHashTable *children_index,
+                       guint64 counter_hz,
+                       int depth)
+{
+  GList *l;
+
+  /* If the timer was reset then we only know what happened since the
+   * reset, not how much changed since the last update */
+  g_string_append_printf (report, "  %*s%-*s %10lu %12.2f%s\n",
+                          depth * 2, "",
+                          MAX (40 - depth * 2, 0), timer->name,
+                          timer->count,
+                          ((float)timer->total / counter_hz) * 1000.0,
+                          timer->reset ? " (reset)" : "");
+
+  for (l = g_hash_table_lookup (children_index, timer->name); l; l = l->next)
+    append_snapshot_timer (report, l->data, children_index,
+                           counter_hz, depth + 1);
+}
+
+static void
+free_children_cb (gpointer key, gpointer value, gpointer user_data)
+{
+  g_list_free (value);
+}
+
+static char *
+format_snapshot (UProfSnapshot *snapshot)
+{
+  GString *report = g_string_new ("");
+  GList *l;
+
+  for (l = snapshot->contexts; l; l = l->next)
+    {
+      UProfSnapshotContext *context = l->data;
+      GHashTable *children_index = g_hash_table_new (g_str_hash,
+                                                     g_str_equal);
+      GList *roots = NULL;
+      GList *l2;
+
+      g_string_append_printf (report, "context: %s\n\n", context->name);
+
+      g_string_append_printf (report, "  %-40s %10s\n", "counter", "count");
+      for (l2 = context->counters; l2; l2 = l2->next)
+        {
+          UProfSnapshotCounter *counter = l2->data;
+          if (snapshot->delta)
+            g_string_append_printf (report, "  %-40s %+10ld%s\n",
+                                    counter->name, counter->delta,
+                                    counter->reset ? " (reset)" : "");
+          else
+            g_string_append_printf (report, "  %-40s %10lu\n",
+                                    counter->name, counter->count);
+        }
+      g_string_append (report, "\n");
+
+      for (l2 = g_list_last (context->timers); l2; l2 = l2->prev)
+        {
+          UProfSnapshotTimer *timer = l2->data;
+
+          if (timer->parent_name)
+            {
+              GList *children = g_hash_table_lookup (children_index,
+                                                     timer->parent_name);
+              g_hash_table_insert (children_index,
+                                   timer->parent_name,
+                                   g_list_prepend (children, timer));
+            }
+          else
+            roots = g_list_prepend (roots, timer);
+        }
+
+      g_string_append_printf (report, "  %-40s %10s %12s\n",
+                              "timer", "count", "total (msecs)");
+      for (l2 = roots; l2; l2 = l2->next)
+        append_snapshot_timer (report, l2->data, children_index,
+                               snapshot->counter_hz, 0);
+      g_string_append (report, "\n");
+
+      g_list_free (roots);
+      g_hash_table_foreach (children_index, free_children_cb, NULL);
+      g_hash_table_destroy (children_index);
+    }
+
+  return g_string_free (report, FALSE);
+}
+
 static void
 get_report_cb (void *user_data)
 {
-  char *report;
-  GError *error;
+  UProfSnapshot *snapshot;
+  char *text_report;
+  GString *report;
+  char *rates;
+  GError *error = NULL;
 
-  error = NULL;
-  report = uprof_report_proxy_get_text_report (report_proxy, &error);
-  if (!report)
+  /* The text report is shown in full since it has everything,
+   * including custom statistics and attributes... */
+  text_report = uprof_report_proxy_get_text_report (report_proxy, &error);
+  if (!text_report)
     {
       ut_warning (UT_WARN_LEVEL_HIGH,
                   "Failed to fetch report: %s", error->message);
       g_error_free (error);
+      return;
     }
-
-  error = NULL;
-  if (!uprof_report_proxy_reset (report_proxy, &error))
+  report = g_string_new (text_report);
+  g_free (text_report);
+
+  /* ...but instead of resetting the report to see what changed since
+   * the last poll, which would interfere with anyone else looking at
+   * the same report, we ask for a delta snapshot. */
+  snapshot = uprof_report_proxy_get_snapshot_since (report_proxy,
+                                                    &snapshot_cursor,
+                                                    &error);
+  if (!snapshot)
     {
       ut_warning (UT_WARN_LEVEL_HIGH,
-                  "Failed to zero report statistics: %s", error->message);
+                  "Failed to fetch changes: %s", error->message);
       g_error_free (error);
     }
+  else
+    {
+      char *changes = format_snapshot (snapshot);
+
+      g_string_append (report, "\nchanges since the last update:\n\n");
+      g_string_append (report, changes);
+      g_free (changes);
+      uprof_snapshot_free (snapshot);
+    }
+
+  /* Only contexts the application is sampling have rates */
+  rates = uprof_report_proxy_get_rates_report (report_proxy, NULL);
+  if (rates)
+    g_string_append (report, rates);
+  g_free (rates);
 
   g_free (timers_counters_report);
-  timers_counters_report = report;
+  timers_counters_report = g_string_free (report, FALSE);
   queue_redraw ();
 }
 
@@ -1263,6 +1386,41 @@ queue_redraw (void)
       g_idle_add ((GSourceFunc)update_window_cb, NULL);
 }
 
+/* This reads the segment directly so it works even if the
+ * application's mainloop is stalled */
+static int
+print_shm_report (const char *name)
+{
+  UProfShmReader *reader;
+  UProfSnapshot *snapshot;
+  char *report;
+  GError *error = NULL;
+
+  reader = uprof_shm_reader_open (name, &error);
+  if (!reader)
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  snapshot = uprof_shm_reader_read (reader, &error);
+  uprof_shm_reader_close (reader);
+  if (!snapshot)
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  report = format_snapshot (snapshot);
+  g_print ("%s", report);
+  g_free (report);
+  uprof_snapshot_free (snapshot);
+
+  return 0;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -1309,6 +1467,9 @@ main (int argc, char **argv)
       return 0;
     }
 
+  if (arg_shm_name)
+    return print_shm_report (arg_shm_name);
+
   if (!arg_report_name)
     {
       g_printerr ("You need to specify a report name if not "
@@ -43,6 +43,8 @@
 #include <glib/gprintf.h>
 #ifndef USE_RDTSC
 #include <time.h>
+#else
+#include <cpuid.h>
 #endif
 #include <unistd.h>
 
@@ -60,59 +62,277 @@
 #endif
 #define REPORT_COLUMN0_WIDTH 40
 
-typedef struct _RDTSCVal
-{
-  union {
-      struct {
-          uint32_t low;
-          uint32_t hi;
-      } split;
-      guint64 full_value;
-  } u;
-} RDTSCVal;
-
 static guint64 system_counter_hz;
-#ifndef USE_RDTSC
-static clockid_t clockid;
+
+_UProfSystemCounterMode _uprof_system_counter_mode;
+
+/* Note: CLOCK_MONOTONIC_RAW isn't subject to NTP slewing */
+#ifdef CLOCK_MONOTONIC_RAW
+#define CLOCK_ID CLOCK_MONOTONIC_RAW
+#define CLOCK_ID_SOURCE "clock_gettime (CLOCK_MONOTONIC_RAW)"
+#else
+#define CLOCK_ID CLOCK_MONOTONIC
+#define CLOCK_ID_SOURCE "clock_gettime (CLOCK_MONOTONIC)"
+#endif
+
+#ifdef USE_RDTSC
+static gboolean use_tsc = TRUE;
+static const char *clock_source = "rdtsc";
+#else
+static const char *clock_source = CLOCK_ID_SOURCE;
 #endif
 
 GList *_uprof_all_contexts;
 UProfContext *mainloop_context = NULL;
 UProfService *service = NULL;
 
-void
-uprof_init_real (void)
+#ifdef USE_RDTSC
+static void
+select_system_counter_mode (void)
 {
-  static gboolean initialized = FALSE;
+  unsigned int eax, ebx, ecx, edx;
 
-  if (initialized)
-    return;
+  /* We can only use the TSC if it's invariant, which means it ticks at
+   * a constant rate regardless of frequency scaling or the CPU going
+   * into deep sleep states and, on any modern system that reports an
+   * invariant TSC, it is also synchronized across cores and sockets so
+   * it doesn't matter if threads migrate between CPUs while timing.
+   *
+   * Otherwise we fall back to clock_gettime() which is implemented in
+   * the vDSO so doesn't need a syscall. */
+  if (!__get_cpuid (0x80000007, &eax, &ebx, &ecx, &edx) ||
+      !(edx & (1 << 8)))
+    {
+      DBG_PRINTF ("No invariant TSC; using " CLOCK_ID_SOURCE "\n");
+      use_tsc = FALSE;
+      clock_source = CLOCK_ID_SOURCE;
+      system_counter_hz = 1000000000;
+      return;
+    }
 
-  g_type_init ();
+  /* Prefer rdtscp if available... */
+  if (__get_cpuid (0x80000001, &eax, &ebx, &ecx, &edx) && (edx & (1 << 27)))
+    {
+      _uprof_system_counter_mode = _UPROF_SYSTEM_COUNTER_MODE_RDTSCP;
+      clock_source = "rdtscp";
+      return;
+    }
 
-#ifndef USE_RDTSC
-  int ret;
+  /* ...otherwise lfence is available with SSE2 */
+  if (__get_cpuid (1, &eax, &ebx, &ecx, &edx) && (edx & (1 << 26)))
+    {
+      _uprof_system_counter_mode = _UPROF_SYSTEM_COUNTER_MODE_RDTSC_LFENCE;
+      clock_source = "lfence + rdtsc";
+    }
+}
+#endif
+
+static guint64
+get_clock_nsecs (void)
+{
   struct timespec ts;
+  guint64 ret;
+
+  clock_gettime (CLOCK_ID, &ts);
 
-  ret = clock_getcpuclockid(0, &clockid);
-  if (ret == ENOENT)
+  ret = ts.tv_sec;
+  ret *= 1000000000;
+  ret += ts.tv_nsec;
+
+  return ret;
+}
+
+#ifdef USE_RDTSC
+static guint64
+get_tsc_hz_from_cpuid (void)
+{
+  unsigned int eax, ebx, ecx, edx;
+
+  /* Leaf 0x15 gives the TSC/crystal clock ratio and, on most recent
+   * CPUs, the crystal frequency too... */
+  if (__get_cpuid (0x15, &eax, &ebx, &ecx, &edx) && eax && ebx)
     {
-      g_warning ("Using the CPU clock will be unreliable on this system if "
-                 "you don't assure processor affinity");
+      if (ecx)
+        return (guint64)ecx * ebx / eax;
+
+      /* ...otherwise the nominal base frequency from leaf 0x16 should
+       * match the TSC frequency */
+      if (__get_cpuid (0x16, &eax, &ebx, &ecx, &edx) && (eax & 0xffff))
+        return (guint64)(eax & 0xffff) * 1000000;
     }
-  else if (ret != 0)
+
+  return 0;
+}
+
+static guint64
+get_tsc_hz_from_sysfs (void)
+{
+  char *contents;
+  guint64 khz = 0;
+
+  if (g_file_get_contents ("/sys/devices/system/cpu/cpu0/tsc_freq_khz",
+                           &contents, NULL, NULL))
     {
-      const char *str = strerror (errno);
-      g_warning ("Failed to get CPU clock ID: %s", str);
+      khz = g_ascii_strtoull (contents, NULL, 10);
+      g_free (contents);
     }
 
-  if (clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts) == -1)
+  return khz * 1000;
+}
+
+/* If we can't find out the frequency of the TSC up front then we
+ * instead compare how far the TSC and CLOCK_ID have advanced since
+ * uprof_init() each time the frequency is queried. The estimate gets
+ * more precise the longer the process has been running and we stop
+ * refining it once we have at least CALIBRATION_NSECS worth of
+ * samples. */
+#define CALIBRATION_NSECS (1000000000/4)
+#define MIN_CALIBRATION_NSECS (1000000000/100)
+
+static guint64 calibration_counter;
+static guint64 calibration_nsecs;
+
+static void
+start_system_counter_calibration (void)
+{
+  guint64 hz;
+
+  if (system_counter_hz)
+    return;
+
+  hz = get_tsc_hz_from_cpuid ();
+  if (!hz)
+    hz = get_tsc_hz_from_sysfs ();
+  if (hz)
     {
-      const char *str = strerror (errno);
-      g_warning ("Failed to query CLOCK_PROCESS_CPUTIME_ID clock: %s", str);
+      DBG_PRINTF ("System Counter HZ: %" G_GUINT64_FORMAT "\n", hz);
+      system_counter_hz = hz;
+      return;
     }
+
+  calibration_counter = uprof_get_system_counter ();
+  calibration_nsecs = get_clock_nsecs ();
+}
+#endif
+
+static guint64
+uprof_calibrate_system_counter (void)
+{
+#ifdef USE_RDTSC
+  guint64 counter;
+  guint64 nsecs;
+  guint64 elapsed;
+  guint64 hz;
 #endif
 
+  if (system_counter_hz)
+    return system_counter_hz;
+
+#ifdef USE_RDTSC
+  if (!calibration_nsecs)
+    start_system_counter_calibration ();
+  if (system_counter_hz)
+    return system_counter_hz;
+
+  /* If we are asked for the frequency immediately after uprof_init()
+   * we have to briefly wait to avoid returning a wildly inaccurate
+   * estimate, but this should be rare. */
+  do
+    {
+      counter = uprof_get_system_counter ();
+      nsecs = get_clock_nsecs ();
+      elapsed = nsecs - calibration_nsecs;
+    }
+  while (elapsed < MIN_CALIBRATION_NSECS);
+
+  hz = (guint64)((double)(counter - calibration_counter) *
+                 1000000000.0 / elapsed);
+
+  DBG_PRINTF ("Diff over %" G_GUINT64_FORMAT "ns: %" G_GUINT64_FORMAT "\n",
+              elapsed, counter - calibration_counter);
+  DBG_PRINTF ("System Counter HZ: %" G_GUINT64_FORMAT "\n", hz);
+
+  /* Note: by saving hz into a global variable, processes that involve
+   * a number of components with individual uprof profiling contexts don't
+   * all need to repeat the callibration. */
+  if (elapsed >= CALIBRATION_NSECS)
+    system_counter_hz = hz;
+
+  return hz;
+#else
+  /* clock_gettime() always counts in nanoseconds */
+  return system_counter_hz = 1000000000;
+#endif
+}
+
+/* The cost of a timer START/STOP pair as seen by an enclosing timer.
+ * We measure an empty loop of START/STOP pairs on a private timer a
+ * few times and take the fastest run to avoid counting interrupts */
+#define OVERHEAD_CALIBRATION_ITERATIONS 1000
+#define OVERHEAD_CALIBRATION_ROUNDS 10
+
+static guint64 timer_overhead;
+
+static void
+calibrate_timer_overhead (void)
+{
+  UPROF_TIMER (timer, NULL, "Overhead calibration", "", 0);
+  UProfTimerState state;
+  UProfSuspendState suspend;
+  guint64 fastest = G_MAXUINT64;
+  int i;
+
+  memset (&state, 0, sizeof (state));
+  memset (&suspend, 0, sizeof (suspend));
+  state.object.suspend = &suspend;
+  state.suspend = &suspend;
+  timer.state = &state;
+
+  for (i = 0; i < OVERHEAD_CALIBRATION_ROUNDS; i++)
+    {
+      guint64 start = _uprof_get_system_counter_inline ();
+      guint64 elapsed;
+      int j;
+
+      for (j = 0; j < OVERHEAD_CALIBRATION_ITERATIONS; j++)
+        {
+          UPROF_TIMER_START (NULL, timer);
+          UPROF_TIMER_STOP (NULL, timer);
+        }
+
+      elapsed = _uprof_get_system_counter_inline () - start;
+      fastest = MIN (fastest, elapsed);
+    }
+
+  timer_overhead = fastest / OVERHEAD_CALIBRATION_ITERATIONS;
+  DBG_PRINTF ("Timer overhead: %" G_GUINT64_FORMAT " ticks\n",
+              timer_overhead);
+}
+
+guint64
+uprof_get_timer_overhead (void)
+{
+  return timer_overhead;
+}
+
+void
+uprof_init_real (void)
+{
+  static gboolean initialized = FALSE;
+
+  if (initialized)
+    return;
+
+  g_type_init ();
+
+#ifdef USE_RDTSC
+  select_system_counter_mode ();
+  if (use_tsc)
+    start_system_counter_calibration ();
+#endif
+
+  calibrate_timer_overhead ();
+
   mainloop_context = uprof_context_new ("Mainloop context");
 
   dbus_g_object_register_marshaller (_uprof_marshal_VOID__STRING_STRING,
@@ -184,106 +404,34 @@ uprof_get_option_group (void)
   return group;
 }
 
-static void
-uprof_calibrate_system_counter (void)
-{
-  guint64 time0, time1 = 0;
-  guint64 diff;
-
-  if (system_counter_hz)
-    return;
-
-  /* Determine the frequency of our time source */
-  DBG_PRINTF ("Determining the frequency of the system counter\n");
-
-  while (1)
-    {
-      struct timespec delay;
-      time0 = uprof_get_system_counter ();
-      delay.tv_sec = 0;
-      delay.tv_nsec = 1000000000/4;
-      if (nanosleep (&delay, NULL) == -1)
-        {
-          if (errno == EINTR)
-            continue;
-          else
-            g_critical ("Failed to init uprof, due to nanosleep error\n");
-        }
-      else
-        {
-          time1 = uprof_get_system_counter ();
-          break;
-        }
-    }
-
-  /* Note: by saving hz into a global variable, processes that involve
-   * a number of components with individual uprof profiling contexts don't
-   * all need to incur a callibration delay. */
-
-  g_assert (time1 > time0);
-  diff = time1 - time0;
-  system_counter_hz = diff * 4;
-
-  DBG_PRINTF ("time0: %" G_GUINT64_FORMAT "\n", time0);
-  DBG_PRINTF (" <sleep for 1/4 second>\n");
-  DBG_PRINTF ("time1: %" G_GUINT64_FORMAT "\n", time1);
-  DBG_PRINTF ("Diff over 1/4 second: %" G_GUINT64_FORMAT "\n", diff);
-  DBG_PRINTF ("System Counter HZ: %" G_GUINT64_FORMAT "\n", system_counter_hz);
-}
-
 guint64
 uprof_get_system_counter (void)
 {
 #ifdef USE_RDTSC
-  RDTSCVal rdtsc;
-
-  /* XXX:
-   * Consider that on some multi processor machines it may be necessary to set
-   * processor affinity.
-   *
-   * For Core 2 Duo, or hyper threaded systems, as I understand it the
-   * rdtsc is driven by the system bus, and so the value is synchronized
-   * across logical cores so we don't need to worry about affinity.
-   *
-   * Also since rdtsc is driven by the system bus, unlike the "Non-Sleep Clock
-   * Ticks" counter it isn't affected by the processor going into power saving
-   * states, which may happen as the processor goes idle waiting for IO.
-   */
-  asm ("rdtsc; movl %%edx,%0; movl %%eax,%1"
-       : "=r" (rdtsc.u.split.hi), "=r" (rdtsc.u.split.low)
-       : /* input */
-       : "%edx", "%eax");
-
-  /* g_print ("counter = %" G_GUINT64_FORMAT "\n",
-              (guint64)rdtsc.u.full_value); */
-  return rdtsc.u.full_value;
-#else
-  struct timespec ts;
-  guint64 ret;
+  /* NB: see select_system_counter_mode() for the conditions under
+   * which we can rely on the TSC */
+  if (G_LIKELY (use_tsc))
+    {
+      if (_uprof_system_counter_mode != _UPROF_SYSTEM_COUNTER_MODE_DEFAULT)
+        return _uprof_get_system_counter_inline ();
 
-#if 0
-  /* XXX: Seems very unreliable compared to simply using rdtsc asm () as above
-   */
-  clock_gettime (clockid, &ts);
-#else
-  clock_gettime (CLOCK_MONOTONIC, &ts);
+      return __rdtsc ();
+    }
 #endif
 
-  ret = ts.tv_sec;
-  ret *= 1000000000;
-  ret += ts.tv_nsec;
-
-  /* g_print ("counter = %" G_GUINT64_FORMAT "\n", (guint64)ret); */
+  return get_clock_nsecs ();
+}
 
-  return ret;
-#endif
+const char *
+uprof_get_system_counter_source (void)
+{
+  return clock_source;
 }
 
 guint64
 uprof_get_system_counter_hz (void)
 {
-  uprof_calibrate_system_counter ();
-  return system_counter_hz;
+  return uprof_calibrate_system_counter ();
 }
 
 UProfContext *
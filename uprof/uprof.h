@@ -21,14 +21,18 @@
 #ifndef _UPROF_H_
 #define _UPROF_H_
 
+#include <uprof-clock.h>
 #include <uprof-context.h>
 #include <uprof-counter.h>
 #include <uprof-counter-result.h>
 #include <uprof-timer.h>
 #include <uprof-timer-result.h>
+#include <uprof-scoped-timer.h>
 #include <uprof-report.h>
 #include <uprof-dbus.h>
 #include <uprof-report-proxy.h>
+#include <uprof-snapshot.h>
+#include <uprof-shm.h>
 
 #include <glib.h>
 
@@ -145,34 +149,6 @@ uprof_init (int *argc, char ***argv);
 GOptionGroup *
 uprof_get_option_group (void);
 
-/**
- * uprof_get_system_counter:
- *
- * Gives direct access to the counter that uprof is using for timing.  On x86
- * platforms this executes the rdtsc instruction to return a 64bit integer that
- * increases at the CPU or system bus frequency. Other platforms fall back to
- * clock_gettime (CLOCK_MONOTONIC, &ts)
- *
- * Returns: a 64bit system counter
- */
-guint64
-uprof_get_system_counter (void);
-
-/**
- * uprof_get_system_counter_hz:
- *
- * Allows you to convert elapsed counts into seconds. Be aware that the
- * calculation of the conversion factor is done in a fairly crude way so it may
- * not be very accurate. This usually isn't a big problem though as any
- * inaccuracy will apply consistently to everything in a uprof report so the
- * numbers still tend to end up relatively useful. It may be worth bearing in
- * mind though if comparing different reports.
- *
- * Returns: A factor that can be used to convert elapsed counts into seconds.
- */
-guint64
-uprof_get_system_counter_hz (void);
-
 /**
  * uprof_find_context:
  * @name: Find an existing uprof context by name